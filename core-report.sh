@@ -0,0 +1,81 @@
+#!/bin/sh
+# Build the freestanding core (sudoku-core.c), report its size and worst case stack and
+# check it on Linux. Fails when the core needs a symbol from outside, uses static memory,
+# or needs more stack than STACK_LIMIT bytes on any call path.
+#   ./core-report.sh                        gcc for this machine
+#   CC=arm-none-eabi-gcc CFLAGS=-mthumb ./core-report.sh    size and stack only for a device
+
+set -e
+cd "$(dirname "$0")"
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:-}
+STACK_LIMIT=${STACK_LIMIT:-256}
+OUT=${OUT:-${TMPDIR:-/tmp}/sudoku-core-build}
+mkdir -p "$OUT"
+
+# freestanding: no libc, no builtins turned into library calls, no memset made from loops
+$CC -Os -ffreestanding -nostdlib -fno-builtin -fno-tree-loop-distribute-patterns -fno-stack-protector \
+    -Wall -Wextra -Werror -Wstack-usage="$STACK_LIMIT" -fstack-usage -fcallgraph-info=su $CFLAGS \
+    -c sudoku-core.c -o "$OUT/sudoku-core.o"
+
+undefined=$(nm -u "$OUT/sudoku-core.o")
+if [ -n "$undefined" ]; then
+    echo "The core needs symbols from outside:"
+    echo "$undefined"
+    exit 1
+fi
+
+echo "Code and static memory:"
+size "$OUT/sudoku-core.o"
+static=$(size "$OUT/sudoku-core.o" | awk 'NR == 2 { print $2 + $3 }')
+if [ "$static" != "0" ]; then
+    echo "The core uses $static bytes of static memory, it has to use none"
+    exit 1
+fi
+
+echo "Stack per function (bytes):"
+sort -t'	' -k2 -n -r "$OUT/sudoku-core.su" | awk -F'\t' '{ split($1, name, ":"); printf "  %-24s %s %s\n", name[4], $2, $3 }'
+
+# worst case over the call graph, the core has no recursion and no indirect calls
+worst=$(awk '
+    /^node:/ {
+        match($0, /title: "[^"]*"/); name = substr($0, RSTART + 8, RLENGTH - 9)
+        bytes[name] = 0
+        if (match($0, /[0-9]+ bytes/)) bytes[name] = substr($0, RSTART, RLENGTH - 6) + 0
+        if ($0 !~ /static/) dynamic = 1
+    }
+    /^edge:/ {
+        match($0, /sourcename: "[^"]*"/); from = substr($0, RSTART + 13, RLENGTH - 14)
+        match($0, /targetname: "[^"]*"/); to = substr($0, RSTART + 13, RLENGTH - 14)
+        calls[from] = calls[from] " " to
+    }
+    function deepest(name,    n, list, k, best, d) {
+        if (name in memo) return memo[name]
+        best = 0
+        n = split(calls[name], list, " ")
+        for (k = 1; k <= n; k++) { d = deepest(list[k]); if (d > best) best = d }
+        return memo[name] = bytes[name] + best
+    }
+    END {
+        worst = 0
+        for (name in bytes) { d = deepest(name); if (d > worst) worst = d }
+        print worst (dynamic ? " (some frames are dynamic)" : "")
+    }' "$OUT/sudoku-core.ci")
+echo "Worst case stack over all call paths: $worst bytes, limit $STACK_LIMIT"
+cat > "$OUT/sizeof.c" <<'EOF'
+#include "sudoku-core.h"
+char coreStateBytes[sizeof(struct sudoku_core)];
+EOF
+$CC -c $CFLAGS -I"$PWD" "$OUT/sizeof.c" -o "$OUT/sizeof.o"
+state=$(nm -S "$OUT/sizeof.o" | awk '/coreStateBytes/ { print $2 }')
+echo "State owned by the caller: $((0x$state)) bytes (struct sudoku_core)"
+if [ "${worst%% *}" -gt "$STACK_LIMIT" ]; then
+    echo "The worst case stack is over the limit"
+    exit 1
+fi
+
+# the check runs on this machine only
+if [ "$CC" = "gcc" ] || [ "$CC" = "cc" ] || [ "$CC" = "clang" ]; then
+    $CC -O2 -Wall -Wextra -DSUDOKU_CORE_CHECK sudoku-core.c -o "$OUT/core-check"
+    "$OUT/core-check"
+fi
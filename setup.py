@@ -0,0 +1,18 @@
+# Build the Python extension module: python3 setup.py build_ext --inplace
+# see sudoku-python.c for the functions and the board format
+from setuptools import Extension, setup
+
+setup(
+    name="sudoku",
+    version="1.0",
+    description="Batch generate, solve, grade and validate Sudoku boards",
+    ext_modules=[
+        Extension(
+            "sudoku",
+            sources=["sudoku-python.c"],
+            depends=["sudoku-linux.c"],
+            extra_compile_args=["-O2", "-pthread"],
+            libraries=["m"],
+        )
+    ],
+)
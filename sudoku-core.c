@@ -0,0 +1,218 @@
+/*
+ * Freestanding generation and validation core of Sudoku, see sudoku-core.h
+ * - Build for a device: gcc -Os -ffreestanding -nostdlib -fno-builtin -fno-tree-loop-distribute-patterns -c sudoku-core.c
+ * - Build the check for Linux: gcc -O2 -DSUDOKU_CORE_CHECK sudoku-core.c -o core-check
+ */
+
+#include "sudoku-core.h"
+
+// box of a cell
+static int coreBox(int cell)
+{
+    return (cell / CORE_N / CORE_BOX) * CORE_BOX + cell % CORE_N / CORE_BOX;
+}
+
+// Seed the random number generator, 0 is not a valid xorshift state
+void coreSeed(struct sudoku_core *core, uint32_t seed)
+{
+    core->random = seed != 0 ? seed : 0x9E3779B9u;
+}
+
+// random number from 0 to num - 1, xorshift32 scaled without a division
+static int coreRandom(struct sudoku_core *core, int num)
+{
+    uint32_t x = core->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    core->random = x;
+    return (int)(((uint64_t)x * (uint32_t)num) >> 32);
+}
+
+// put a digit in a cell of the solution and mark it used in its units
+static void corePlace(struct sudoku_core *core, int cell, int num)
+{
+    core->solved[cell] = (uint8_t)num;
+    core->rows[cell / CORE_N] |= (uint16_t)(1 << num);
+    core->cols[cell % CORE_N] |= (uint16_t)(1 << num);
+    core->boxes[coreBox(cell)] |= (uint16_t)(1 << num);
+}
+
+// fill the diagonal boxes with shuffled digits, they do not share a unit
+static void coreFillDiagonal(struct sudoku_core *core)
+{
+    for (int b = 0; b < CORE_N; b += CORE_BOX + 1)
+    {
+        uint8_t digits[CORE_N];
+        for (int k = 0; k < CORE_N; k++)
+            digits[k] = (uint8_t)(k + 1);
+        for (int k = CORE_N - 1; k > 0; k--)
+        {
+            int other = coreRandom(core, k + 1);
+            uint8_t swap = digits[k];
+            digits[k] = digits[other];
+            digits[other] = swap;
+        }
+        int first = (b / CORE_BOX) * CORE_BOX * CORE_N + (b % CORE_BOX) * CORE_BOX;
+        for (int k = 0; k < CORE_N; k++)
+            corePlace(core, first + (k / CORE_BOX) * CORE_N + k % CORE_BOX, digits[k]);
+    }
+}
+
+// fill the empty cells in order with the lowest digit that fits, backtracking on an
+// explicit stack like fillRemaining(), returns false if no digit fits the first cell
+static bool coreFillRemaining(struct sudoku_core *core)
+{
+    int count = 0, depth = 0;
+    for (int cell = 0; cell < CORE_CELLS; cell++)
+        if (core->solved[cell] == 0)
+            core->cells[count++] = (uint8_t)cell;
+    core->tried[0] = 0;
+
+    while (depth < count)
+    {
+        int cell = core->cells[depth];
+        int used = core->rows[cell / CORE_N] | core->cols[cell % CORE_N] | core->boxes[coreBox(cell)];
+        int num = core->tried[depth] + 1;
+        while (num <= CORE_N && (used & (1 << num)))
+            num++;
+
+        if (num <= CORE_N)
+        {
+            corePlace(core, cell, num);
+            core->tried[depth++] = (uint8_t)num;
+            core->tried[depth] = 0;
+            continue;
+        }
+        if (depth == 0)
+            return false;
+
+        // take back the digit of the previous cell, it tries its next digit
+        cell = core->cells[--depth];
+        num = core->tried[depth];
+        core->solved[cell] = 0;
+        core->rows[cell / CORE_N] &= (uint16_t)~(1 << num);
+        core->cols[cell % CORE_N] &= (uint16_t)~(1 << num);
+        core->boxes[coreBox(cell)] &= (uint16_t)~(1 << num);
+    }
+    return true;
+}
+
+// copy the solution and remove the digits of emptyCells random cells, always in 81 steps
+// where addEmptyCells() draws cells until it hits enough filled ones
+static void coreAddEmptyCells(struct sudoku_core *core, int emptyCells)
+{
+    for (int cell = 0; cell < CORE_CELLS; cell++)
+    {
+        core->puzzle[cell] = core->solved[cell];
+        core->cells[cell] = (uint8_t)cell;
+    }
+    for (int k = 0; k < emptyCells; k++)
+    {
+        int other = k + coreRandom(core, CORE_CELLS - k);
+        uint8_t cell = core->cells[other];
+        core->cells[other] = core->cells[k];
+        core->cells[k] = cell;
+        core->puzzle[cell] = 0;
+    }
+}
+
+// Fill the board and remove emptyCells digits, false if emptyCells is out of range
+bool coreGenerate(struct sudoku_core *core, int emptyCells)
+{
+    if (emptyCells < 0 || emptyCells > CORE_CELLS)
+        return false;
+    for (int k = 0; k < CORE_CELLS; k++)
+        core->solved[k] = 0;
+    for (int k = 0; k < CORE_N; k++)
+        core->rows[k] = core->cols[k] = core->boxes[k] = 0;
+
+    coreFillDiagonal(core);
+    if (!coreFillRemaining(core))
+        return false; // never happens after the diagonal boxes, kept for safety
+    coreAddEmptyCells(core, emptyCells);
+    return true;
+}
+
+// Check if a digit can go in a cell without repeating in its row, column or box
+bool coreIsSafe(const uint8_t grid[CORE_CELLS], int cell, int num)
+{
+    int row = cell / CORE_N, col = cell % CORE_N;
+    int first = (row / CORE_BOX) * CORE_BOX * CORE_N + (col / CORE_BOX) * CORE_BOX;
+    for (int k = 0; k < CORE_N; k++)
+    {
+        if (grid[row * CORE_N + k] == num || grid[k * CORE_N + col] == num ||
+            grid[first + (k / CORE_BOX) * CORE_N + k % CORE_BOX] == num)
+            return false;
+    }
+    return true;
+}
+
+// Check if the board is solved, every cell is filled with the digit of the solution
+bool coreIsSolved(const uint8_t grid[CORE_CELLS], const uint8_t solved[CORE_CELLS])
+{
+    int differ = 0;
+    for (int cell = 0; cell < CORE_CELLS; cell++)
+        differ |= grid[cell] ^ solved[cell];
+    return differ == 0;
+}
+
+// Check a completed grid against the rules and against the clues, clues may be NULL
+// every unit has to hold all nine digits, so any completion of the puzzle is accepted
+bool coreValidate(const uint8_t grid[CORE_CELLS], const uint8_t clues[CORE_CELLS])
+{
+    uint16_t rows[CORE_N] = {0}, cols[CORE_N] = {0}, boxes[CORE_N] = {0};
+    int wrong = 0;
+    for (int cell = 0; cell < CORE_CELLS; cell++)
+    {
+        int num = grid[cell];
+        uint16_t bit = (uint16_t)(num >= 1 && num <= CORE_N ? 1 << num : 0);
+        rows[cell / CORE_N] |= bit;
+        cols[cell % CORE_N] |= bit;
+        boxes[coreBox(cell)] |= bit;
+        if (clues != 0)
+            wrong |= clues[cell] != 0 && clues[cell] != num;
+    }
+    for (int k = 0; k < CORE_N; k++)
+        wrong |= (rows[k] & cols[k] & boxes[k]) != 0x3FE;
+    return wrong == 0;
+}
+
+#ifdef SUDOKU_CORE_CHECK
+// Check for Linux, not part of the freestanding build: generate puzzles on every level and
+// check them with the core itself
+#include <stdio.h>
+
+int main()
+{
+    static const int levels[] = {13, 29, 41, 64};
+    struct sudoku_core core;
+    int checked = 0, failed = 0;
+
+    coreSeed(&core, 1);
+    for (int l = 0; l < 4; l++)
+    {
+        for (int k = 0; k < 10000; k++)
+        {
+            int empty = 0, wrongClue = 0;
+            bool ok = coreGenerate(&core, levels[l]) && coreValidate(core.solved, core.puzzle) &&
+                      coreIsSolved(core.solved, core.solved) && !coreIsSolved(core.puzzle, core.solved);
+            for (int cell = 0; cell < CORE_CELLS; cell++)
+            {
+                empty += core.puzzle[cell] == 0;
+                // a clue is safe in its cell once the cell is emptied again
+                uint8_t grid[CORE_CELLS];
+                for (int c = 0; c < CORE_CELLS; c++)
+                    grid[c] = core.solved[c];
+                grid[cell] = 0;
+                wrongClue |= !coreIsSafe(grid, cell, core.solved[cell]);
+            }
+            checked++;
+            failed += !ok || empty != levels[l] || wrongClue;
+        }
+    }
+    printf("%d puzzles checked, %d failed, struct sudoku_core is %d bytes\n", checked, failed,
+           (int)sizeof(struct sudoku_core));
+    return failed != 0;
+}
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Freestanding generation and validation core of Sudoku
+ * - The same pipeline as fillValues() in sudoku-linux.c, for devices without a full libc
+ * - No printf, no system(), no heap and no static memory: all state lives in a
+ *   struct sudoku_core owned by the caller, the search runs on an explicit stack in it
+ * - Only <stdint.h> and <stdbool.h> are used, both are there in a freestanding build
+ * - Run ./core-report.sh for the code size, the worst case stack and a check on Linux
+ */
+
+#ifndef SUDOKU_CORE_H
+#define SUDOKU_CORE_H
+
+#include <stdint.h>     // for the fixed size integers
+#include <stdbool.h>    // for bool data type
+
+#define CORE_N 9            // Size of the board
+#define CORE_BOX 3          // Size of the mini box 3x3
+#define CORE_CELLS 81       // Cells of the board, cell ids are row * CORE_N + col
+
+// State of the core, the only memory it uses besides a small stack (see core-report.sh)
+struct sudoku_core {
+    uint8_t solved[CORE_CELLS];     // Sudoku board with all cells filled
+    uint8_t puzzle[CORE_CELLS];     // Sudoku board with empty cells (0)
+    uint8_t tried[CORE_CELLS + 1];  // digit tried at every depth of the fill search
+    uint8_t cells[CORE_CELLS];      // empty cells of the fill search, then the removal order
+    uint16_t rows[CORE_N];          // digits used in every row, bit d for digit d
+    uint16_t cols[CORE_N];          // digits used in every column
+    uint16_t boxes[CORE_N];         // digits used in every box
+    uint32_t random;                // state of the random number generator
+};
+
+void coreSeed(struct sudoku_core *core, uint32_t seed);    // seed the random number generator
+bool coreGenerate(struct sudoku_core *core, int emptyCells);   // fill the board and remove digits, like fillValues()
+bool coreIsSafe(const uint8_t grid[CORE_CELLS], int cell, int num);   // check if a digit fits a cell, like checkIfSafe()
+bool coreIsSolved(const uint8_t grid[CORE_CELLS], const uint8_t solved[CORE_CELLS]);  // compare with the solution, like isBoardSolved()
+bool coreValidate(const uint8_t grid[CORE_CELLS], const uint8_t clues[CORE_CELLS]);   // check a completed grid against the rules and the clues
+
+#endif
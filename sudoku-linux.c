@@ -20,6 +20,16 @@
  * - stdbool.h
  * - time.h
  * - math.h
+ * - string.h
+ * - unistd.h
+ * - pthread.h
+ * - sched.h
+ * - stdatomic.h
+ * - termios.h, sys/epoll.h, sys/timerfd.h
+ * - sys/socket.h, sys/un.h, netinet/in.h, arpa/inet.h
+ * - fcntl.h, sys/mman.h, sys/stat.h, sys/wait.h, signal.h
+ * - sys/ioctl.h, sys/syscall.h, sys/resource.h, linux/perf_event.h
+ * - sys/sdt.h (optional, for the tracepoints)
  * 
  * @section NOTES
  * This program is tested on Ubuntu 20.04 LTS using GCC 11.4.0
@@ -27,21 +37,93 @@
  * 
  * @section Usage
  * - Compile the program using C compiler (gcc, clang, mingw, etc)
+ *   e.g. gcc -O2 sudoku-linux.c -o sudoku -lm -pthread
  * - Run the executable file
+ * - Run with --bench <name> to benchmark a part of the engine (see README)
  * - You can also download the executable file from the releases section of this repository
 */
 
+#ifndef _GNU_SOURCE    // Python.h defines it when sudoku-python.c includes this file
+#define _GNU_SOURCE     // for clock_gettime and other POSIX/GNU extensions
+#endif
+
 #include <stdio.h>      // for input and output
 #include <stdlib.h>     // for system function like cls to clear the screen
 #include <stdbool.h>    // for bool data type
 #include <time.h>    // for time function
 #include <math.h>   // for math functions like rand function
+#include <string.h>     // for strcmp and memcpy
+#include <unistd.h>     // for read and write in the protocol mode
+#include <pthread.h>    // for the bot threads
+#include <sched.h>      // for sched_yield
+#include <stdatomic.h>  // for the lock free queue
+#include <termios.h>    // for the raw terminal of the live mode
+#include <sys/epoll.h>  // for the event loop of the live mode
+#include <sys/timerfd.h>    // for the clock of the live mode
+#include <sys/socket.h> // for the metrics listener
+#include <sys/un.h>     // for the metrics listener on a Unix socket
+#include <netinet/in.h> // for the metrics listener on TCP
+#include <arpa/inet.h>  // for inet_pton
+#include <fcntl.h>      // for open of the stats files
+#include <sys/file.h>   // for flock on the stats log
+#include <errno.h>      // for telling a stats store in use from other errors
+#include <sys/mman.h>   // for the memory mapped stats index
+#include <sys/stat.h>   // for fstat and mkdir
+#include <sys/wait.h>   // for waitpid on the local farm workers
+#include <signal.h>     // for kill
+#include <sys/ioctl.h>  // for enabling the performance counters
+#include <sys/syscall.h>    // for perf_event_open, which has no libc wrapper
+#include <sys/resource.h>   // for getrusage when there are no performance counters
+#include <linux/perf_event.h>   // for the performance counter events
+
+// Static tracepoints (USDT) for bpftrace and perf, see the scripts in tracing/. A probe is a
+// NOP in the code and a note in the binary, a tracer turns it into a breakpoint when it
+// attaches. Without <sys/sdt.h> (systemtap-sdt-dev) or with -DSUDOKU_NO_PROBES the probes
+// compile to nothing.
+#if defined(__has_include) && !defined(SUDOKU_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SUDOKU_PROBES
+#endif
+#endif
+#ifdef SUDOKU_PROBES
+#define TRACE1(name, a) DTRACE_PROBE1(sudoku, name, a)
+#define TRACE3(name, a, b, c) DTRACE_PROBE3(sudoku, name, a, b, c)
+#define TRACE4(name, a, b, c, d) DTRACE_PROBE4(sudoku, name, a, b, c, d)
+#else
+#define TRACE1(name, a) do { } while (0)
+#define TRACE3(name, a, b, c) do { } while (0)
+#define TRACE4(name, a, b, c, d) do { } while (0)
+#endif
 
 #define N 9             // Size of the board
 #define MINI_BOX_SIZE 3 // Size of the mini box 3x3
 #define EASY_LVL 13      // Number of empty cells for easy level
 #define MEDIUM_LVL 29   // Number of empty cells for medium level
 #define HARD_LVL 41     // Number of empty cells for hard level
+#define MAX_EMPTY_CELLS 72  // Most empty cells addEmptyCells() can make, it never empties the last column
+#define UNITS 27        // Number of units (9 rows, 9 columns and 9 boxes)
+#define PEERS 20        // Number of cells sharing a unit with a cell
+#define ALL_DIGITS 0x3FE    // Candidate mask with bits 1 to 9 set
+#define SOLUTION_RANK_BYTES 11  // Bytes needed to store a ranked solution
+#define LATENCY_BUCKETS 40      // Number of power of two buckets in a latency histogram
+#define SESSION_SLAB 4096       // Number of game sessions in one slab of a session pool
+#define CACHE_LINE 64           // Size of a cache line, shared data is padded to it
+#define HDR_SUB_BITS 6          // Precision of the HDR histograms, 32 buckets per power of two
+#define HDR_BUCKETS 1216        // Buckets of an HDR histogram, values up to about 10^12 ns
+#define METRIC_THREADS 256      // Most threads that can record metrics
+#define BAND_CELLS 27           // Cells in a band of three rows, one 32 bit word of a bitboard
+#define BAND_FULL 0x7FFFFFF     // All 27 cells of a band
+#define SOLVE_PATH_STEPS 160    // Most steps kept in a solve path
+#define PATH_NO_CELL 127        // Cell of a path step that places nothing
+#define DEAD_END_BUDGET 81      // Most singles placed by the dead end check after a move
+#define STATS_COMPACT_RECORDS (1 << 20)    // Log records that make the stats store compact
+#define STATS_LEVELS 3          // Levels with their own stats: easy, medium and hard
+#define FARM_WORKERS 256        // Most workers connected to a farm coordinator
+#define FARM_CLUE_BYTES 11      // Bytes of the clue mask of a farm puzzle, one bit per cell
+#define PERF_EVENTS 5           // Most counters read by the benchmarks at the same time
+#define SHARED_PLAYERS 64       // Most players on one shared board at once, one bit each
+#define SHARED_CLUE 255         // Player of a clue in a shared cell word
 
 // Sudoku board structure
 struct sudoku_board {
@@ -50,12 +132,429 @@ struct sudoku_board {
     int emptyCells;     // Number of empty cells
 };
 
-struct sudoku_board board;  // Global variable to store the board
+// Logical solve path of a puzzle, every step packed in 32 bits by pathStep()
+struct solve_path {
+    unsigned int steps[SOLVE_PATH_STEPS];
+    int count;          // number of steps, 0 if no path was computed
+    int cursor;         // no step before it can be the next hint
+    unsigned char stepOfCell[N * N];    // step that places every cell, 255 for clues
+};
+
+// Candidates of a puzzle in three views kept in sync: the digit mask of every cell, the
+// cells of every digit as three bands of 27 cells, and the positions of every digit in
+// every unit, the transposed view the subset and fish detectors work on
+struct candidate_planes {
+    unsigned short cells[N * N];    // digits 1 to 9 as bits, 0 for a filled cell
+    unsigned int digits[N + 1][MINI_BOX_SIZE];  // cells where a digit can go, digit 0 unused
+    unsigned short positions[UNITS][N + 1];     // positions 0 to 8 in the unit where a digit can go
+    unsigned short placed[UNITS];   // digits placed in every unit
+    int value[N * N];   // placed digits
+    int left;           // empty cells
+};
+
+// Game state structure
+struct game_state {
+    int difficulty;     // Number of empty cells of the chosen level
+    int attempts;       // Number of values entered by the player
+    unsigned int seed;  // Seed of the random number generator used for the board
+    int moves;          // Number of accepted values in the journal
+    unsigned char journal[N * N];   // Cells (row * N + col) of the accepted values, used for undo
+    struct solve_path *path;    // Logical solve path for hints, NULL until gameRecordPath()
+    struct candidate_planes *planes;    // Candidates of the board in free entry, NULL in checked entry
+};
+
+// Game session structure, one independent game in a session pool
+struct game_session {
+    struct sudoku_board board;  // board pair of the game
+    struct game_state game;     // attempts, seed and journal
+    unsigned long long random;  // random number generator state, gives the seeds of the next games
+    unsigned int generation;    // incremented when the session is freed, so old handles stop working
+    int nextFree;               // next free session in the free list, -1 at the end
+    bool inUse;                 // set from sessionCreate() to sessionDestroy()
+};
+
+// Pool of game sessions, sessions live in fixed slabs and freed sessions are reused
+// a pool is not locked, every thread serving games should own its pool
+struct session_pool {
+    struct game_session **slabs;    // slabs of SESSION_SLAB sessions
+    int slabCount;      // number of allocated slabs
+    int freeList;       // first free session, -1 if there is none
+    int used;           // number of sessions in use
+};
+
+// Finished puzzle with both grids, one digit per byte, passed between threads
+struct puzzle_record {
+    unsigned char solved[N * N];    // solution
+    unsigned char unsolved[N * N];  // puzzle, 0 for empty cells
+};
+
+// Slot of a puzzle queue, the sequence number tells whose turn it is
+struct puzzle_slot {
+    _Atomic unsigned long long sequence;
+    struct puzzle_record record;
+};
+
+// Bounded lock free multi producer multi consumer queue of puzzles
+struct puzzle_queue {
+    struct puzzle_slot *slots;
+    unsigned long long mask;    // capacity - 1, the capacity is a power of two
+    _Alignas(CACHE_LINE) _Atomic unsigned long long enqueuePos;  // next position to write
+    _Alignas(CACHE_LINE) _Atomic unsigned long long dequeuePos;  // next position to read
+};
+
+// Bounded multi producer multi consumer queue of puzzles with a mutex, for comparison
+struct locked_queue {
+    pthread_mutex_t lock;
+    struct puzzle_record *records;
+    unsigned long long mask;    // capacity - 1
+    unsigned long long head;    // next position to read
+    unsigned long long tail;    // next position to write
+};
+
+// Shard of the parallel generation engine, one per worker thread
+// padded to whole cache lines so workers never write to a shared line
+struct generation_shard {
+    _Alignas(CACHE_LINE) pthread_t thread;
+    int index;              // shard number
+    int cpu;                // core the worker is pinned to, -1 for no pinning
+    int shards;             // total number of shards
+    int difficulty;         // number of empty cells of the puzzles
+    long long count;        // puzzles of all shards, this shard makes every shards-th one
+    unsigned int seed;      // seed of puzzle 0, puzzle k uses seed + k
+    struct puzzle_record *records;  // puzzles of this shard, allocated by the worker
+    long long generated;    // puzzles made by this shard
+    long long checksum;     // sum of all clues, to compare runs
+    long long nanoseconds;  // time the worker spent generating
+};
+
+// Result of running a fill search
+enum fill_status {
+    FILL_DONE,          // every cell is filled
+    FILL_FAILED,        // there is no way to fill the cells
+    FILL_PAUSED         // the step budget ran out, run again to continue
+};
+
+// Backtracking search on an explicit stack, it fills the empty cells of a board
+// frames 0 to depth - 1 hold placed digits, frame depth is the cell being tried
+struct fill_search {
+    struct sudoku_board *board;     // board being filled, must not move while searching
+    int rows[N], cols[N], boxes[N];     // digits used in every unit, as bit masks
+    int cells[N * N];   // cells to fill, from left to right and top to bottom
+    int cellCount;      // number of cells to fill
+    int depth;          // current frame
+    int tried[N * N + 1];   // digit placed (or last tried) in every frame
+    long long nodes;    // digits placed
+    long long backtracks;   // digits taken back
+};
+
+// Phases of the lazy puzzle generator
+enum generator_phase {
+    GEN_DIAGONAL,       // filling the diagonal boxes
+    GEN_SEARCH,         // filling the remaining cells by backtracking
+    GEN_EMPTY,          // removing digits to make the empty cells
+    GEN_READY           // the puzzle is ready in the generator's board
+};
+
+// Lazy puzzle generator, a resumable state machine that makes one puzzle after another
+// it works on its own board and random state, so it never disturbs the global board
+struct puzzle_generator {
+    struct sudoku_board board;  // puzzle being made, complete when the phase is GEN_READY
+    unsigned long long random;  // random number generator state
+    int difficulty;     // number of empty cells
+    int phase;          // one of generator_phase
+    int box;            // next diagonal box to fill
+    int removed;        // digits removed so far
+    int boxes[N];       // digits used in every box while the diagonal boxes are filled
+    struct fill_search search;  // search filling the remaining cells
+    long long steps;    // steps made so far
+};
+
+// Events of the live mode event loop
+enum live_event {
+    EVENT_KEY,          // a key was pressed
+    EVENT_TICK,         // the clock timer fired
+    EVENT_GENERATED     // the background generator finished the next puzzle
+};
+
+// Keys of the live mode besides plain characters
+enum live_key {
+    KEY_UP = 256,
+    KEY_DOWN,
+    KEY_LEFT,
+    KEY_RIGHT
+};
+
+// Difficulty bands of graded puzzles
+enum difficulty_band {
+    BAND_INVALID,       // the puzzle has no solution or more than one
+    BAND_EASY,          // naked singles solve it
+    BAND_MEDIUM,        // hidden singles are needed
+    BAND_HARD,          // singles get stuck, harder techniques or guesses are needed
+    BAND_COUNT
+};
+
+// Grading result of a puzzle
+struct grade_report {
+    int band;           // one of difficulty_band
+    int nakedSingles;   // cells placed as naked singles
+    int hiddenSingles;  // cells placed as hidden singles
+    int stuckCells;     // empty cells left when singles got stuck
+    int solutions;      // number of solutions, counted up to 2
+};
+
+// Bitboard of a puzzle being solved: for every digit the cells where it can still go
+// or where it was placed, as three bands of 27 cells
+struct bitboard {
+    unsigned int planes[N][MINI_BOX_SIZE];  // digit 1 is planes[0]
+    unsigned int unsolved[MINI_BOX_SIZE];   // cells without a digit
+};
+
+// Shared state of one speculative band request
+struct band_race {
+    int band;           // wanted band
+    unsigned int seed;  // attempt k uses seeds from seed + k * 1000003
+    _Atomic int winner; // attempt that found the puzzle, -1 while racing
+    struct sudoku_board result;     // puzzle of the winner
+};
+
+// One speculative attempt of a band request
+struct band_attempt {
+    pthread_t thread;
+    struct band_race *race;
+    int index;
+    long long work;         // CPU time spent by the attempt in ns
+    long long winningWork;  // CPU time of the candidate that won, 0 for losers
+    int candidates;         // puzzles generated and graded
+};
+
+// HDR histogram of latencies in ns, written by one thread and read by the scraper
+struct hdr_histogram {
+    _Atomic long long counts[HDR_BUCKETS];
+    _Atomic long long total;    // number of values
+    _Atomic long long sum;      // sum of values in ns
+};
+
+// Histograms and counters of the metrics
+enum metric_histogram {
+    METRIC_GENERATE,    // time of fillValues()
+    METRIC_SOLVE,       // time of countSolutions()
+    METRIC_GRADE,       // time of gradePuzzle()
+    METRIC_HISTOGRAMS
+};
+enum metric_counter {
+    METRIC_PUZZLES,     // puzzles generated
+    METRIC_BACKTRACKS,  // digits taken back by the fill search
+    METRIC_TIMEOUTS,    // requests slower than the deadline
+    METRIC_CACHE_HITS,  // cache hits of the search
+    METRIC_COUNTERS
+};
+
+// Metrics of one thread, merged by the scraper
+struct thread_metrics {
+    struct hdr_histogram histograms[METRIC_HISTOGRAMS];
+    _Alignas(CACHE_LINE) _Atomic long long counters[METRIC_COUNTERS];
+};
+
+// Transposition table of the counting search, shared by all threads
+// an entry is one word: the Zobrist hash with the cached count + 1 in the low two bits
+struct transposition_table {
+    _Atomic unsigned long long *entries;    // NULL while the table is off
+    unsigned long long mask;    // number of entries - 1
+};
+
+// Counters of the counting search of one thread
+struct search_stats {
+    long long nodes;    // digits placed
+    long long probes;   // lookups in the transposition table
+    long long hits;     // lookups that found a count
+};
+
+// Finished game of a player, one fixed size record in the stats log
+struct stats_record {
+    unsigned long long player;  // id of the player, see statsPlayerId()
+    unsigned int when;          // time the game ended in seconds since 1970
+    unsigned int seconds;       // time spent on the game
+    unsigned int attempts;      // values entered
+    unsigned char level;        // 0 easy, 1 medium, 2 hard
+    unsigned char solved;       // 1 if the board was solved, 0 if the player gave up
+    unsigned short unused;
+};
+
+// Stats of one player, the entries of the stats index are sorted by player
+struct player_stats {
+    unsigned long long player;  // id of the player
+    unsigned int games;         // games finished or given up
+    unsigned int solved[STATS_LEVELS];  // games solved on every level
+    unsigned int best[STATS_LEVELS];    // fastest solve on every level in seconds, 0 if none
+    unsigned int attempts;      // values entered in all games
+    unsigned int seconds;       // time spent in all games
+    unsigned int streak;        // games solved in a row up to the last one
+    unsigned int bestStreak;    // longest run of solved games
+    unsigned int first;         // time of the first game
+    unsigned int last;          // time of the last game
+    unsigned int unused;
+};
+
+// Header of a stats file, the index header has the size of an entry so the entries stay aligned
+struct stats_header {
+    char magic[8];              // "SUDSTATI" for the index, "SUDSTATL" for the log
+    unsigned long long generation;  // compactions done, a log older than the index was merged already
+    unsigned long long count;   // entries in the index
+    unsigned long long unused[5];
+};
+
+// Store of the stats of all players in a directory
+struct stats_store {
+    char *dir;              // directory of the files
+    int log;                // append only log of the games since the last compaction
+    void *map;              // stats.index mapped into memory, NULL if there is none yet
+    size_t mapBytes;
+    const struct player_stats *index;   // sorted entries of the index
+    unsigned long long indexCount;
+    unsigned long long generation;  // generation of the index and of the log
+    struct player_stats *delta; // players with games in the log, open addressing on the player id
+    unsigned long long deltaMask;   // slots - 1
+    unsigned long long deltaCount;  // players in the table
+    unsigned long long logRecords;  // records in the log
+    unsigned long long compactAt;   // records in the log that start the next compaction
+};
+
+// Messages between the farm coordinator and its workers
+enum farm_message_type {
+    FARM_HELLO,         // worker: ready for a lease
+    FARM_LEASE,         // coordinator: generate the puzzles of a lease
+    FARM_RESULT,        // worker: the puzzles of a lease follow the message
+    FARM_DONE           // coordinator: no work is left, disconnect
+};
+
+// Message header of the farm protocol, both ends are assumed to have the same byte order
+struct farm_message {
+    unsigned int type;          // one of farm_message_type
+    unsigned int lease;         // number of the lease
+    unsigned long long first;   // first puzzle of the lease, puzzle k uses seed + k
+    unsigned int count;         // puzzles in the lease
+    unsigned int difficulty;    // number of empty cells
+    unsigned int seed;          // seed of puzzle 0
+    unsigned int unused;
+};
+
+// Puzzle sent back by a farm worker, 24 bytes instead of the 162 of a puzzle record
+struct farm_puzzle {
+    unsigned char rank[SOLUTION_RANK_BYTES];    // solution, see rankSolution()
+    unsigned char clues[FARM_CLUE_BYTES];   // bit c is set if cell c is a clue
+    unsigned char band;         // grade of the puzzle, one of difficulty_band
+    unsigned char unused;
+};
+
+// Lease of a range of puzzles, handed to a worker until its result arrives
+struct farm_lease {
+    int worker;         // worker holding the lease, -1 if nobody does
+    bool done;          // the result arrived
+    long long deadline; // time the lease expires in ns
+};
+
+// Connection of a farm worker
+struct farm_worker {
+    int fd;             // socket, -1 for a free slot
+    int lease;          // lease the worker is on, -1 if idle
+};
+
+// State of a farm coordinator
+struct farm_coordinator {
+    struct farm_worker workers[FARM_WORKERS];
+    struct farm_lease *leases;
+    int leaseCount;         // leases of the bank
+    int nextLease;          // first lease that was never handed out
+    int leasesDone;         // leases with their result
+    long long count;        // puzzles of the bank
+    unsigned int leaseSize; // puzzles per lease
+    unsigned int difficulty;    // number of empty cells
+    unsigned int seed;      // seed of puzzle 0
+    long long timeout;      // time a worker has for a lease in ns
+    long long reassigned;   // leases handed to another worker
+    long long resultBytes;  // bytes of results received
+    struct farm_puzzle *puzzles;    // the bank in puzzle order
+};
+
+// Where the counters of the benchmarks come from, the PMU is often missing in a VM
+enum perf_mode {
+    PERF_HARDWARE,      // cycles, instructions, branch misses, L1D and LLC misses
+    PERF_SOFTWARE,      // task clock, page faults and context switches of the kernel
+    PERF_CLOCK,         // thread CPU time and page faults, perf_event_open is not allowed
+    PERF_MODES
+};
+
+// Counters of one benchmark phase, counting only while started
+struct perf_counters {
+    int mode;                       // one of perf_mode
+    int fds[PERF_EVENTS];           // counters, the first one leads the group, -1 if missing
+    long long values[PERF_EVENTS];  // counts of the finished intervals in PERF_CLOCK mode
+    long long started[PERF_EVENTS]; // counts when the interval started in PERF_CLOCK mode
+    long long intervals;            // perfStart() calls since the last report
+    double overhead[PERF_EVENTS];   // counts of an empty interval, taken off every interval
+};
+
+// Techniques of the steps of a solve path
+enum solve_technique {
+    STEP_NAKED_SINGLE,  // the only digit left in a cell
+    STEP_HIDDEN_SINGLE, // the only cell left for a digit in a unit
+    STEP_NAKED_SUBSET,  // cells of a unit with as many digits between them
+    STEP_HIDDEN_SUBSET, // digits of a unit with as many cells between them
+    STEP_FISH,          // rows or columns with as many cross lines for a digit
+    STEP_GUESS,         // no technique applies, the digit comes from the solution
+    STEP_TECHNIQUES
+};
+
+// Board that many players solve at the same time, every cell is one packed word changed
+// with compare and swap, see Shared Boards
+struct shared_board {
+    _Atomic unsigned int cells[N * N];      // packed cell words, made by sharedCellWord()
+    _Atomic unsigned int changes[N * N];    // cell words of the accepted moves in order, 0 until written
+    _Alignas(CACHE_LINE) _Atomic int changeCount;   // changes claimed by the writers
+    _Atomic unsigned long long players;    // bit of every player id in use, SHARED_PLAYERS bits
+    int emptyCells;         // empty cells when the game started
+    unsigned int seed;      // seed of the board
+};
+
+// Player on a shared board, owned by the thread serving the player
+struct shared_player {
+    struct shared_board *board;
+    int id;             // player number on the board, stored in the cells the player fills
+    int cursor;         // changes of the board the player has seen
+    int attempts;       // values entered
+    int placed;         // values the player put in first
+    int lost;           // right values another player put in first
+};
+
+// Result of a move
+enum move_result {
+    MOVE_ACCEPTED,      // value is correct and was put in the cell
+    MOVE_WRONG,         // value does not match the solution
+    MOVE_FILLED,        // cell is already filled
+    MOVE_INVALID,       // row, column or value is out of range
+    MOVE_DEAD_END       // free entry: value was put in the cell but the board has no completion left
+};
+
+_Thread_local struct sudoku_board board;  // Global variable to store the board, every thread has its own
+_Thread_local unsigned long long randomState = 1;   // state of the random number generator of this thread
+_Thread_local struct thread_metrics *threadMetrics;  // metrics of this thread, NULL if it does not record
+struct thread_metrics *_Atomic metricsRegistry[METRIC_THREADS];  // metrics of all recording threads, NULL until stored
+_Atomic int metricsThreads;     // number of registered threads
+unsigned long long zobristKeys[N * N][N + 1];   // random key of every digit in every cell, 0 for empty
+struct transposition_table transposition;  // cache of the counting search, off until transpositionInit()
+_Thread_local struct search_stats searchStats;  // counting search counters of this thread
+
+int unitCells[UNITS][N];    // cell ids (row * N + col) of every row, column and box
+int cellPeers[N * N][PEERS];    // cell ids of the 20 peers of every cell
+unsigned int peerBands[N * N][MINI_BOX_SIZE];  // peers of every cell as a bitboard
+char maskText[ALL_DIGITS + 1][4];   // decimal text of every candidate mask, used by the JSON writer
+int maskTextLength[ALL_DIGITS + 1];     // number of digits in maskText
 
 
 // Function declarations
 void clearScreen();     // clear the screen
 int randomGenerator(int num);   // random number generator
+void seedRandom(unsigned int seed);     // seed the random number generator of this thread
 bool checkIfSafe(int i, int j, int num);    // check if it is safe to put the number in specific cell
 bool isAbsentInBox(int rowStart, int colStart, int num);    // check if the number is absent in the 3x3 box
 bool isAbsentInRow(int i, int num);     // check if the number is absent in the row
@@ -63,19 +562,170 @@ bool isAbsentInCol(int j, int num);     // check if the number is absent in the
 void fillValues();      // fill the board with values
 void fillDiagonal();    // fill the diagonal 3 number of 3x3 boxes
 void fillBox(int row, int col);     // fill a 3x3 box
-bool fillRemaining(int i, int j);   // fill the remaining cells recursively
+bool fillRemaining(int i, int j);   // fill the remaining cells with an explicit stack
+bool fillRemainingRecursive(int i, int j);  // fill the remaining cells recursively, the original search
 void addEmptyCells();   // remove digits from the board to create empty cells
 void printSudoku();     // print the sudoku board
 bool isBoardSolved();   // check if the board is solved
 void resetBoard();      // reset the board to all 0s
+void initTables();      // fill the unit and peer tables
+long long nowNanoseconds();     // monotonic clock in nanoseconds
+int runCommandLine(int argc, char *argv[]);     // handle command line options
+bool rankSolution(int grid[N][N], unsigned char rank[SOLUTION_RANK_BYTES]);   // encode a solved grid into a compact rank
+bool unrankSolution(const unsigned char rank[SOLUTION_RANK_BYTES], int grid[N][N]);   // decode a rank back into the solved grid
+bool rankPlace(unsigned short cand[N * N], int value[N * N], int cell, int num);   // place a digit and propagate singles
+void benchmarkRank(int count);  // benchmark solution ranking and unranking
+const char *difficultyName(int emptyCells);     // name of the level with the given number of empty cells
+int difficultyFromName(const char *name, int length);   // number of empty cells of a level name
+void boardCandidates(const int grid[N][N], unsigned short cand[N * N]);  // candidate masks of the empty cells
+int boardToJson(const struct sudoku_board *b, const struct game_state *game, char *buf, int size);  // write board and game state as JSON
+bool boardFromJson(const char *json, int length, struct sudoku_board *b, struct game_state *game);  // read board and game state from JSON
+void benchmarkJson(int count);  // benchmark JSON encoding and decoding
+void newGame(struct sudoku_board *b, struct game_state *game, int difficulty, unsigned int seed);   // generate a board for a new game
+void loadGame(struct sudoku_board *b, struct game_state *game, const int puzzle[N][N], const int solution[N][N]);  // start a game on a given puzzle
+bool gameFreeEntry(const struct sudoku_board *b, struct game_state *game, bool on);  // switch free entry on or off
+bool gameRecordPath(const struct sudoku_board *b, struct game_state *game);   // record the solve path of the board for hints
+void gameFree(struct game_state *game);     // free the path and the planes of a game
+int applyMove(struct sudoku_board *b, struct game_state *game, int row, int col, int num);   // validate a move and put the value
+bool undoMove(struct sudoku_board *b, struct game_state *game, int *row, int *col);  // take back the last accepted value
+int protocolCommand(struct sudoku_board *b, struct game_state *game, char *line, char *reply);  // run one protocol command
+int runProtocol();      // serve the line protocol on stdin and stdout
+void benchmarkProtocol(int count);  // benchmark the protocol command processing
+double optionNumber(int argc, char *argv[], const char *name, double fallback);  // value of a name=value option
+int optionLevel(int argc, char *argv[], int fallback);  // level=easy|medium|hard|cells option, -1 if invalid
+int runBots(int argc, char *argv[]);    // play generated games with bots and report the engine speed
+unsigned long long sessionCreate(struct session_pool *pool, int difficulty, unsigned int seed);  // start a game in a new session
+struct game_session *sessionGet(struct session_pool *pool, unsigned long long handle);  // session of a handle, NULL if stale
+bool sessionNewGame(struct session_pool *pool, unsigned long long handle, int difficulty);  // start the next game of a session
+bool sessionDestroy(struct session_pool *pool, unsigned long long handle);  // free a session for reuse
+void sessionPoolFree(struct session_pool *pool);    // free all slabs of a pool
+void benchmarkSessions(int count);  // benchmark a session pool
+void puzzleRecordFromBoard(const struct sudoku_board *b, struct puzzle_record *record);    // pack a board into a puzzle record
+bool puzzleQueueInit(struct puzzle_queue *q, int capacity);    // allocate a lock free queue
+int puzzleQueuePush(struct puzzle_queue *q, const struct puzzle_record *records, int count);   // add up to count puzzles
+int puzzleQueuePop(struct puzzle_queue *q, struct puzzle_record *records, int count);  // take up to count puzzles
+void puzzleQueueFree(struct puzzle_queue *q);   // free a lock free queue
+bool lockedQueueInit(struct locked_queue *q, int capacity);    // allocate a queue with a mutex
+int lockedQueuePush(struct locked_queue *q, const struct puzzle_record *records, int count);   // add up to count puzzles
+int lockedQueuePop(struct locked_queue *q, struct puzzle_record *records, int count);  // take up to count puzzles
+void lockedQueueFree(struct locked_queue *q);   // free a queue with a mutex
+void benchmarkQueue(int count);     // compare the lock free queue with the mutex queue
+int parseCpuList(const char *text, int *cpus, int max);     // parse a CPU list like 0-3,8
+double runGenerationEngine(struct generation_shard *shards, int count, const int *cpus, int cpuCount);  // generate puzzles on all shards
+int runGenerate(int argc, char *argv[]);    // generate a bank of puzzles in parallel
+void benchmarkGenerate(int count);  // compare pinned and unpinned generation
+void fillSearchInit(struct fill_search *search, struct sudoku_board *b, int start);   // prepare a search for the empty cells from start on
+int fillSearchRun(struct fill_search *search, long long budget);    // run a search for at most budget steps, -1 for no limit
+int fillSearchCheckpoint(const struct fill_search *search, unsigned char *out);    // save the position of a search
+bool fillSearchRestore(struct fill_search *search, const unsigned char *in, int length);   // continue a search from a checkpoint
+void benchmarkFill(int count);      // compare the explicit stack search with the recursive one
+int runLive(int argc, char *argv[]);    // play with a clock in an event loop
+int countSolutions(const int grid[N][N], int limit);   // count the solutions of a puzzle up to limit
+int countSolutionsMasks(const int grid[N][N], int limit);  // count the solutions with checkIfSafe() style backtracking
+int gradePuzzle(const int grid[N][N], struct grade_report *report);    // grade a puzzle into a difficulty band
+const char *bandName(int band);     // name of a difficulty band
+double generateInBand(int band, int attempts, struct sudoku_board *out, int *candidates);   // race attempts for a puzzle in a band
+int runBand(int argc, char *argv[]);    // serve speculative band requests and report the wasted work
+bool metricsRegister();     // start recording metrics on this thread
+void metricsRecord(int histogram, long long ns);    // record a latency of this thread
+void metricsCount(int counter, long long amount);   // add to a counter of this thread
+int metricsText(char *buf, int size);   // merge all threads into the Prometheus text format
+int runService(int argc, char *argv[]);     // generate puzzles and serve the metrics
+void benchmarkMetrics(int count);   // measure the cost of recording a latency
+int bitboardSolve(const int grid[N][N], int solution[N][N], int limit);    // solve with the bitboard engine
+void benchmarkSolve(const char *path, int count);   // compare the bitboard engine with the backtracking search
+bool validateGrid(const int grid[N][N], const int clues[N][N]);    // check a completed grid against the rules and the clues
+int validateGrids(const int (*grids)[N][N], const int (*clues)[N][N], int count, unsigned char *valid);  // validate many grids
+void benchmarkValidate(int count);  // measure the validator on a batch of grids
+unsigned long long zobristHash(const int grid[N][N]);  // Zobrist hash of the digits of a grid
+bool transpositionInit(int bits);   // turn on the transposition table with 2^bits entries
+void transpositionFree();   // turn off the transposition table
+int minimizePuzzle(int grid[N][N]);    // remove clues while the solution stays unique
+void benchmarkTransposition(int count, int bits);  // compare the counting search with and without the table
+void planesInit(struct candidate_planes *cp, const int grid[N][N]);    // candidates of a grid in all views
+void planesEliminate(struct candidate_planes *cp, int cell, int num);  // take a candidate out of all views
+void planesPlace(struct candidate_planes *cp, int cell, int num);  // put a digit and take it from the peers
+int planesSingles(struct candidate_planes *cp);     // place naked and hidden singles until there are none
+int nakedSubsets(struct candidate_planes *cp, int size, struct solve_path *path);   // eliminate with naked pairs, triples or quads
+int hiddenSubsets(struct candidate_planes *cp, int size, struct solve_path *path);  // eliminate with hidden pairs, triples or quads
+int fishPatterns(struct candidate_planes *cp, int size, struct solve_path *path);   // eliminate with X-Wings, Swordfish or Jellyfish
+void benchmarkTechniques(int count);    // time one pass of every technique on stuck puzzles
+unsigned int pathStep(int technique, int cell, int num, int unit, int members);   // pack a solve path step
+int solvePath(const int grid[N][N], const int solution[N][N], struct solve_path *path);  // record the logical solve path of a puzzle
+int pathNextHint(struct solve_path *path, const int grid[N][N]);   // step of the next hint, -1 if none
+int pathEncode(const struct solve_path *path, unsigned char *out);  // write a path as 4 bytes per step
+bool pathDecode(const unsigned char *in, int length, struct solve_path *path);  // read a path written by pathEncode()
+const char *techniqueName(int technique);   // name of a solve technique
+void benchmarkPath(int count);      // compare hints from the path with solving for every hint
+bool planesDeadEnd(const struct candidate_planes *cp, int budget);  // look for a contradiction with bounded propagation
+void benchmarkDeadEnd(int count);   // measure the dead end check on free entry games
+unsigned long long statsPlayerId(const char *name);  // id of a player name
+bool statsOpen(struct stats_store *store, const char *dir);    // open or create the stats store in a directory
+bool statsRecord(struct stats_store *store, const struct stats_record *record);   // append a finished game
+bool statsLookup(const struct stats_store *store, unsigned long long player, struct player_stats *out);   // stats of a player
+bool statsCompact(struct stats_store *store);   // merge the log into a new index
+void statsClose(struct stats_store *store);     // unmap and close the stats store
+int statsLevel(int difficulty);     // stats level of a number of empty cells
+int runStats(int argc, char *argv[]);   // print the stats of a player or of the store
+void benchmarkStats(int count);     // measure writes, lookups and compaction of the stats store
+void farmGenerate(const struct farm_message *lease, struct farm_puzzle *out);  // generate and grade the puzzles of a lease
+int farmWorker(const char *where);  // connect to a farm coordinator and work on its leases until it is done
+int runFarm(int argc, char *argv[]);    // run a farm coordinator or worker
+int perfOpen(struct perf_counters *pc);    // open the best counters available, returns the mode
+void perfStart(struct perf_counters *pc);  // count from here
+void perfStop(struct perf_counters *pc);   // stop counting, the counts are kept
+void perfReport(struct perf_counters *pc, const char *phase, long long units, const char *unit);  // print the counts per unit and reset them
+void perfClose(struct perf_counters *pc);  // close the counters
+void benchmarkCounters(int count);  // count events in every phase of generating and solving
+unsigned int sharedCellWord(int cell, int num, int solution, int player);  // pack a shared cell word
+void sharedBoardInit(struct shared_board *sb, int difficulty, unsigned int seed);  // generate a game on a shared board
+bool sharedJoin(struct shared_board *sb, struct shared_player *p);    // join a shared board as a new player
+void sharedLeave(struct shared_player *p);  // leave a shared board, its player id can be taken again
+int sharedMove(struct shared_player *p, int row, int col, int num);    // put a value on a shared board
+int sharedChanges(struct shared_player *p, unsigned int *changes, int max);    // changes since the cursor of a player
+void sharedSnapshot(const struct shared_board *sb, int grid[N][N]);   // digits of a shared board
+bool sharedSolved(const struct shared_board *sb);   // check if every cell of a shared board is filled
+int sharedCommand(struct shared_player *p, struct shared_board *boards, int count, char *line, char *reply);  // run one command of a shared board player
+int runShared(int argc, char *argv[]);  // serve shared boards to players over sockets
+void benchmarkShared(int count);    // play shared boards with many writers, lock free and with a mutex
+void generatorInit(struct puzzle_generator *g, int difficulty, unsigned int seed);  // start a lazy generator
+bool generatorStep(struct puzzle_generator *g, int budget);    // advance a lazy generator by a bounded number of steps
+void generatorNext(struct puzzle_generator *g, struct sudoku_board *out);  // run a lazy generator to the next puzzle
+void benchmarkLazy(int count);      // pull puzzles in small slices and measure the longest slice
 
 /* =========== Main Function =========== */
-int main()
+int main(int argc, char *argv[])
 {
+    initTables(); // fill the unit and peer tables
+
+    // run a command line option instead of the game if any was given
+    if (argc > 1 && strcmp(argv[1], "--protocol") == 0)
+        return runProtocol();
+    if (argc > 1 && strcmp(argv[1], "--bot") == 0)
+        return runBots(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--generate") == 0)
+        return runGenerate(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--live") == 0)
+        return runLive(argc, argv);
+    if (argc > 2 && strcmp(argv[1], "--band") == 0)
+        return runBand(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--service") == 0)
+        return runService(argc, argv);
+    if (argc > 2 && strcmp(argv[1], "--stats") == 0)
+        return runStats(argc, argv);
+    if (argc > 2 && strcmp(argv[1], "--farm") == 0)
+        return runFarm(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--shared") == 0)
+        return runShared(argc, argv);
+    if (argc > 1)
+        return runCommandLine(argc, argv);
+
     // run the program in a loop until the user wants to exit
     while (true)  // run the program in an infinite loop until the user wants to exit
     {
-        srand((unsigned int)time(NULL)); // seed the random number generator
+        struct game_state game = {0}; // state of this game
+        game.seed = (unsigned int)time(NULL);
+        seedRandom(game.seed); // seed the random number generator
 
         clearScreen(); // clear the screen
 
@@ -110,14 +760,15 @@ int main()
             board.emptyCells = MEDIUM_LVL;
             printf("\nMedium level selected\n\n");
         }
+        game.difficulty = board.emptyCells;
 
         resetBoard(); // reset the board
         fillValues(); // fill the board with values
         printSudoku(); // print the board
 
         // ask for row, column and value from the user
-        // and also save the number of attempts
-        int row, col, num, attempts = 0;
+        // and also save the number of attempts in the game state
+        int row, col, num;
 
         while (!isBoardSolved()) // run the loop until the board is solved
         {
@@ -176,12 +827,9 @@ int main()
                     goto enterValue; // if the user wants to try again then go to enterValue label
             }
 
-            attempts++; // increment the number of attempts
-
-            // check if the value is safe to put in the cell
-            if (board.solved[row][col] == num)
-                board.unsolved[row][col] = num; // if safe then put the value in the cell
-            else
+            // check the value against the solution and put it in the cell if it matches
+            // this also increments the number of attempts
+            if (applyMove(&board, &game, row, col, num) != MOVE_ACCEPTED)
             {
                 // if not safe then ask the user if they want to try again
                 printf("Invalid value! Try again? (y/n) ");
@@ -194,7 +842,7 @@ int main()
             clearScreen(); // clear the screen
 
             // print the number of attempts and the board
-            printf("Attempted %d times\n\n", attempts);
+            printf("Attempted %d times\n\n", game.attempts);
             printSudoku();
         }
         // while loop ends here when the board is solved
@@ -231,10 +879,22 @@ void clearScreen()
 }
 
 
-// Random generator
+// Random generator, returns a number from 1 to num
+// xorshift64* on a per thread state, so threads can generate boards side by side
 int randomGenerator(int num)
 {
-    return (int)((double)((float)rand() / RAND_MAX * num) + 1);
+    randomState ^= randomState >> 12;
+    randomState ^= randomState << 25;
+    randomState ^= randomState >> 27;
+    unsigned int r = (unsigned int)((randomState * 2685821657736338717ULL) >> 32);
+    return (int)((double)r / 4294967296.0 * num) + 1;
+}
+
+// Seed the random number generator of this thread
+void seedRandom(unsigned int seed)
+{
+    // spread the seed over all 64 bits, the state must never be 0
+    randomState = ((unsigned long long)seed + 1) * 0x9E3779B97F4A7C15ULL;
 }
 
 // Check if safe to put in cell
@@ -294,6 +954,7 @@ bool isAbsentInCol(int j, int num)
 // Fill the board with values
 void fillValues()
 {
+    TRACE1(fill_start, board.emptyCells); // probe: a board is generated with this many empty cells
     fillDiagonal(); // Fill the diagonal MINI_BOX_SIZE x MINI_BOX_SIZE matrices
     fillRemaining(0, MINI_BOX_SIZE);    // Fill remaining blocks
 
@@ -304,6 +965,7 @@ void fillValues()
             board.solved[i][j] = board.unsolved[i][j];
     }
     addEmptyCells();    // remove the K no. of digits from the board
+    TRACE1(fill_done, board.emptyCells);  // probe: the board is ready
 }
 
 // Fill the diagonal MINI_BOX_SIZE number of MINI_BOX_SIZE x MINI_BOX_SIZE matrices
@@ -334,9 +996,20 @@ void fillBox(int row, int col)
     }
 }
 
-// diagnoal box is filled, below function will fill the rest of the cells recursively
-// A recursive function to fill remaining matrix
+// diagnoal box is filled, below function will fill the rest of the cells
+// the search runs on an explicit stack, see fillSearchRun()
 bool fillRemaining(int i, int j) // i is row and j is column
+{
+    struct fill_search search;
+    fillSearchInit(&search, &board, i * N + j); // the empty cells from (i, j) on
+    bool filled = fillSearchRun(&search, -1) == FILL_DONE;
+    metricsCount(METRIC_BACKTRACKS, search.backtracks);
+    return filled;
+}
+
+// A recursive function to fill remaining matrix
+// this is the original search, kept to benchmark the explicit stack against it
+bool fillRemainingRecursive(int i, int j) // i is row and j is column
 {
     // if all column is filled then move to next row
     if (j >= N && i < N - 1)
@@ -393,7 +1066,7 @@ bool fillRemaining(int i, int j) // i is row and j is column
         {
             board.unsolved[i][j] = num; // put the number in the cell
 
-            if (fillRemaining(i, j + 1)) // fill the remaining cells recursively
+            if (fillRemainingRecursive(i, j + 1)) // fill the remaining cells recursively
             {
                 return true; // board is filled
             }
@@ -422,6 +1095,7 @@ void addEmptyCells()
         if (board.unsolved[i][j] != 0) // if the cell is not empty then remove the number from the cell
         {
             count--; // decrement the count
+            TRACE3(hole, i, j, count); // probe: the digit of a cell is removed, count are still to go
             board.unsolved[i][j] = 0; // remove the number from the cell
         }
     }
@@ -492,3 +1166,6310 @@ void resetBoard()
             board.unsolved[i][j] = 0;
     }
 }
+
+// Fill the unit and peer tables
+void initTables()
+{
+    for (int u = 0; u < N; u++)
+    {
+        for (int k = 0; k < N; k++)
+        {
+            unitCells[u][k] = u * N + k; // row u
+            unitCells[N + u][k] = k * N + u; // column u
+            // box u, boxes are numbered from left to right and top to bottom
+            unitCells[2 * N + u][k] = ((u / MINI_BOX_SIZE) * MINI_BOX_SIZE + k / MINI_BOX_SIZE) * N
+                                      + (u % MINI_BOX_SIZE) * MINI_BOX_SIZE + k % MINI_BOX_SIZE;
+        }
+    }
+
+    // a peer shares the row, the column or the box with the cell
+    for (int cell = 0; cell < N * N; cell++)
+    {
+        int i = cell / N, j = cell % N, count = 0;
+        for (int other = 0; other < N * N; other++)
+        {
+            int oi = other / N, oj = other % N;
+            if (other != cell && (oi == i || oj == j ||
+                (oi / MINI_BOX_SIZE == i / MINI_BOX_SIZE && oj / MINI_BOX_SIZE == j / MINI_BOX_SIZE)))
+                cellPeers[cell][count++] = other;
+        }
+    }
+
+    // the peers as bitboards of three bands
+    for (int cell = 0; cell < N * N; cell++)
+        for (int p = 0; p < PEERS; p++)
+            peerBands[cell][cellPeers[cell][p] / BAND_CELLS] |= 1u << (cellPeers[cell][p] % BAND_CELLS);
+
+    // Zobrist keys from a fixed splitmix64 sequence, so hashes are the same in every run
+    unsigned long long mix = 0x5D0C5EEDull;
+    for (int cell = 0; cell < N * N; cell++)
+        for (int num = 1; num <= N; num++)
+        {
+            unsigned long long z = (mix += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            zobristKeys[cell][num] = z ^ (z >> 31);
+        }
+
+    for (int mask = 0; mask <= ALL_DIGITS; mask++)
+    {
+        char text[8];
+        maskTextLength[mask] = sprintf(text, "%d", mask);
+        memcpy(maskText[mask], text, 4);
+    }
+}
+
+// Monotonic clock in nanoseconds, used for timing
+long long nowNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Handle command line options
+int runCommandLine(int argc, char *argv[])
+{
+    if (strcmp(argv[1], "--bench") == 0 && argc > 2)
+    {
+        int count = argc > 3 ? atoi(argv[3]) : 0; // optional number of iterations
+
+        if (strcmp(argv[2], "rank") == 0)
+            benchmarkRank(count > 0 ? count : 10000);
+        else if (strcmp(argv[2], "json") == 0)
+            benchmarkJson(count > 0 ? count : 1000000);
+        else if (strcmp(argv[2], "protocol") == 0)
+            benchmarkProtocol(count > 0 ? count : 1000000);
+        else if (strcmp(argv[2], "sessions") == 0)
+            benchmarkSessions(count > 0 ? count : 10000);
+        else if (strcmp(argv[2], "queue") == 0)
+            benchmarkQueue(count > 0 ? count : 1000000);
+        else if (strcmp(argv[2], "generate") == 0)
+            benchmarkGenerate(count > 0 ? count : 20000);
+        else if (strcmp(argv[2], "lazy") == 0)
+            benchmarkLazy(count > 0 ? count : 5000);
+        else if (strcmp(argv[2], "fill") == 0)
+            benchmarkFill(count > 0 ? count : 5000);
+        else if (strcmp(argv[2], "metrics") == 0)
+            benchmarkMetrics(count > 0 ? count : 10000000);
+        else if (strcmp(argv[2], "validate") == 0)
+            benchmarkValidate(count > 0 ? count : 1000000);
+        else if (strcmp(argv[2], "tt") == 0)
+            benchmarkTransposition(count > 0 ? count : 20, (int)optionNumber(argc, argv, "tt", 16));
+        else if (strcmp(argv[2], "techniques") == 0)
+            benchmarkTechniques(count > 0 ? count : 200);
+        else if (strcmp(argv[2], "path") == 0)
+            benchmarkPath(count > 0 ? count : 200);
+        else if (strcmp(argv[2], "counters") == 0)
+            benchmarkCounters(count > 0 ? count : 2000);
+        else if (strcmp(argv[2], "stats") == 0)
+            benchmarkStats(count > 0 ? count : 1000000);
+        else if (strcmp(argv[2], "deadend") == 0)
+            benchmarkDeadEnd(count > 0 ? count : 2000);
+        else if (strcmp(argv[2], "shared") == 0)
+            benchmarkShared(count > 0 ? count : 4096);
+        else if (strcmp(argv[2], "solve") == 0)
+            benchmarkSolve(argc > 3 && count == 0 ? argv[3] : NULL, count > 0 ? count : 2000);
+        else
+        {
+            printf("Unknown benchmark: %s\n", argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+
+    printf("Usage: %s [--protocol | --live [level=L] [free=1] [stats=DIR player=NAME] | --bot [name=value ...] | --generate [name=value ...] |\n"
+           "          --band easy|medium|hard [attempts=A] [count=C] | --service [name=value ...] |\n"
+           "          --stats DIR [player] [compact=1] | --farm coordinator|worker [name=value ...] |\n"
+           "          --shared [name=value ...] |\n"
+           "          --bench rank|json|protocol|sessions|queue|generate|lazy|fill|metrics|solve|validate|tt|techniques|path|deadend|shared|stats|counters [count]]\n", argv[0]);
+    return 1;
+}
+
+
+/* =========== Solution Ranking =========== */
+
+// A solved grid is ranked as a mixed radix number. Cells are visited from left to right
+// and top to bottom, and each cell stores the index of its digit among the candidates
+// still open for it. After every placement naked and hidden singles are propagated, so
+// forced cells cost nothing. Decoding replays the same propagation, so it always knows
+// the radix of the next cell. A solution needs about 74 bits on average (the real
+// information is 72.5 bits), so it always fits in SOLUTION_RANK_BYTES bytes.
+
+// Place num in cell and propagate naked and hidden singles
+// returns false if the candidates run into a contradiction
+bool rankPlace(unsigned short cand[N * N], int value[N * N], int cell, int num)
+{
+    // cells and digits waiting to be placed, the queue starts over whenever it drains. Between
+    // two drains it holds the first move or the hidden singles of one unit (at most N), and
+    // naked singles, which a cell becomes only once. A cell can be queued both ways, so two
+    // pairs per cell always fit, also for the ranks that farm workers send
+    int queue[N * N * 4], head = 0, tail = 0;
+    queue[tail++] = cell;
+    queue[tail++] = num;
+
+    while (head < tail)
+    {
+        while (head < tail)
+        {
+            int c = queue[head++], d = queue[head++];
+            if (value[c] != 0)
+            {
+                if (value[c] != d)
+                    return false; // two different digits forced into the same cell
+                continue;
+            }
+            if (!(cand[c] & (1 << d)))
+                return false; // digit is not a candidate anymore
+
+            value[c] = d;
+            cand[c] = 1 << d;
+
+            // remove the digit from the peers
+            for (int p = 0; p < PEERS; p++)
+            {
+                int peer = cellPeers[c][p];
+                if (value[peer] != 0 || !(cand[peer] & (1 << d)))
+                    continue;
+                cand[peer] &= ~(1 << d);
+                if (cand[peer] == 0)
+                    return false; // no digit left for the peer
+                if ((cand[peer] & (cand[peer] - 1)) == 0) // naked single
+                {
+                    queue[tail++] = peer;
+                    queue[tail++] = __builtin_ctz(cand[peer]);
+                }
+            }
+        }
+        head = tail = 0;
+
+        // look for hidden singles once the naked singles are exhausted
+        for (int u = 0; u < UNITS && head == tail; u++)
+        {
+            int once = 0, twice = 0, placed = 0;
+            for (int k = 0; k < N; k++)
+            {
+                int c = unitCells[u][k];
+                if (value[c] != 0)
+                    placed |= 1 << value[c];
+                else
+                {
+                    twice |= once & cand[c];
+                    once |= cand[c];
+                }
+            }
+            if ((once | placed) != ALL_DIGITS)
+                return false; // some digit has no place left in the unit
+
+            int hidden = once & ~twice & ~placed;
+            for (int k = 0; k < N && hidden != 0; k++)
+            {
+                int c = unitCells[u][k];
+                if (value[c] == 0 && (cand[c] & hidden))
+                {
+                    queue[tail++] = c;
+                    queue[tail++] = __builtin_ctz(cand[c] & hidden);
+                    hidden &= ~cand[c];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Encode a solved grid into a compact rank
+// returns false if the grid is not a valid solution
+bool rankSolution(int grid[N][N], unsigned char rank[SOLUTION_RANK_BYTES])
+{
+    unsigned short cand[N * N];
+    int value[N * N] = {0};
+    unsigned __int128 index = 0, weight = 1;
+
+    for (int c = 0; c < N * N; c++)
+        cand[c] = ALL_DIGITS;
+
+    for (int c = 0; c < N * N; c++)
+    {
+        int num = grid[c / N][c % N];
+        if (value[c] != 0)
+        {
+            if (value[c] != num)
+                return false; // the grid breaks a forced placement
+            continue;
+        }
+        if (num < 1 || num > N || !(cand[c] & (1 << num)))
+            return false;
+
+        // the digit is stored as its index among the open candidates
+        index += weight * __builtin_popcount(cand[c] & ((1 << num) - 1));
+        weight *= __builtin_popcount(cand[c]);
+
+        if (!rankPlace(cand, value, c, num))
+            return false;
+    }
+
+    if ((weight >> (8 * SOLUTION_RANK_BYTES)) != 0)
+        return false; // does not fit, never seen on a valid grid
+
+    for (int b = 0; b < SOLUTION_RANK_BYTES; b++)
+        rank[b] = (unsigned char)(index >> (8 * b));
+    return true;
+}
+
+// Decode a rank back into the solved grid
+// returns false if the rank does not describe a grid
+bool unrankSolution(const unsigned char rank[SOLUTION_RANK_BYTES], int grid[N][N])
+{
+    unsigned short cand[N * N];
+    int value[N * N] = {0};
+    unsigned __int128 index = 0;
+
+    for (int b = SOLUTION_RANK_BYTES - 1; b >= 0; b--)
+        index = (index << 8) | rank[b];
+
+    for (int c = 0; c < N * N; c++)
+        cand[c] = ALL_DIGITS;
+
+    for (int c = 0; c < N * N; c++)
+    {
+        if (value[c] != 0)
+            continue; // forced by an earlier placement
+
+        int radix = __builtin_popcount(cand[c]);
+        int k = (int)(index % radix);
+        index /= radix;
+
+        // pick the k-th open candidate
+        int mask = cand[c];
+        while (k-- > 0)
+            mask &= mask - 1;
+
+        if (!rankPlace(cand, value, c, __builtin_ctz(mask)))
+            return false;
+    }
+
+    if (index != 0)
+        return false; // rank is out of range
+
+    for (int c = 0; c < N * N; c++)
+        grid[c / N][c % N] = value[c];
+    return true;
+}
+
+// Benchmark solution ranking and unranking
+void benchmarkRank(int count)
+{
+    static int grids[1000][N][N]; // solved grids to encode
+    static unsigned char ranks[1000][SOLUTION_RANK_BYTES];
+    int total = count < 1000 ? count : 1000;
+    double bits = 0, maxBits = 0;
+
+    seedRandom((unsigned int)time(NULL));
+    for (int g = 0; g < total; g++)
+    {
+        resetBoard();
+        board.emptyCells = 0; // keep the board fully solved
+        fillValues();
+        memcpy(grids[g], board.solved, sizeof(board.solved));
+    }
+
+    long long start = nowNanoseconds();
+    for (int r = 0; r < count; r++)
+    {
+        if (!rankSolution(grids[r % total], ranks[r % total]))
+        {
+            printf("Ranking failed!\n");
+            return;
+        }
+    }
+    long long encoded = nowNanoseconds();
+
+    int decoded[N][N];
+    for (int r = 0; r < count; r++)
+        unrankSolution(ranks[r % total], decoded);
+    long long end = nowNanoseconds();
+
+    // check the round trip and measure the used bits
+    for (int g = 0; g < total; g++)
+    {
+        if (!unrankSolution(ranks[g], decoded) || memcmp(decoded, grids[g], sizeof(decoded)) != 0)
+        {
+            printf("Round trip failed!\n");
+            return;
+        }
+        int used = 0;
+        for (int b = 0; b < SOLUTION_RANK_BYTES; b++)
+            if (ranks[g][b] != 0)
+                used = b * 8 + 32 - __builtin_clz(ranks[g][b]);
+        bits += used;
+        if (used > maxBits)
+            maxBits = used;
+    }
+
+    printf("Ranked %d solutions into %d bytes each\n", count, SOLUTION_RANK_BYTES);
+    printf("Encode: %.2f us per grid\n", (encoded - start) / 1000.0 / count);
+    printf("Decode: %.2f us per grid\n", (end - encoded) / 1000.0 / count);
+    printf("Rank size: %.1f bits on average, %.0f bits at most\n", bits / total, maxBits);
+}
+
+
+/* =========== JSON Encoding =========== */
+
+// Boards are written as one object, for example
+// {"difficulty":"hard","attempts":3,"seed":42,"emptyCells":41,"unsolved":"5300...","solved":"5346...","candidates":[0,...]}
+// Grids are strings of 81 digits (0 for an empty cell) and candidates are the bit masks
+// (bits 1 to 9) of the digits still possible in each cell. Nothing is allocated, the
+// writer fills the caller's buffer and the reader parses in place.
+
+// Name of the level with the given number of empty cells
+const char *difficultyName(int emptyCells)
+{
+    switch (emptyCells)
+    {
+    case EASY_LVL:
+        return "easy";
+    case MEDIUM_LVL:
+        return "medium";
+    case HARD_LVL:
+        return "hard";
+    default:
+        return "custom";
+    }
+}
+
+// Number of empty cells of a level name, -1 if the name is unknown
+int difficultyFromName(const char *name, int length)
+{
+    if (length == 4 && memcmp(name, "easy", 4) == 0)
+        return EASY_LVL;
+    if (length == 6 && memcmp(name, "medium", 6) == 0)
+        return MEDIUM_LVL;
+    if (length == 4 && memcmp(name, "hard", 4) == 0)
+        return HARD_LVL;
+    return -1;
+}
+
+// Candidate masks of the empty cells, 0 for filled cells
+void boardCandidates(const int grid[N][N], unsigned short cand[N * N])
+{
+    int bits[N][N], rows[N], cols[N] = {0}, boxes[N] = {0}; // digits used in every unit
+
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++)
+            bits[i][j] = (1 << grid[i][j]) & ALL_DIGITS;
+
+    for (int i = 0; i < N; i++)
+    {
+        int row = 0;
+        for (int j = 0; j < N; j++)
+        {
+            row |= bits[i][j];
+            cols[j] |= bits[i][j];
+            boxes[(i / MINI_BOX_SIZE) * MINI_BOX_SIZE + j / MINI_BOX_SIZE] |= bits[i][j];
+        }
+        rows[i] = row;
+    }
+
+    // branch free: the mask is cleared for filled cells
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++)
+            cand[i * N + j] = (unsigned short)(~(rows[i] | cols[j] | boxes[(i / MINI_BOX_SIZE) * MINI_BOX_SIZE + j / MINI_BOX_SIZE])
+                                               & ALL_DIGITS & -(bits[i][j] == 0));
+}
+
+// append a string literal to the JSON buffer
+#define JSON_LITERAL(p, text) (memcpy((p), (text), sizeof(text) - 1), (p) += sizeof(text) - 1)
+
+// append a non negative integer to the JSON buffer
+static char *jsonWriteInt(char *p, unsigned int value)
+{
+    char digits[10];
+    int count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (count > 0)
+        *p++ = digits[--count];
+    return p;
+}
+
+// append a grid as a string of 81 digits to the JSON buffer
+static char *jsonWriteGrid(char *p, const int grid[N][N])
+{
+    *p++ = '"';
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++)
+            *p++ = (char)('0' + grid[i][j]);
+    *p++ = '"';
+    return p;
+}
+
+// append a candidate mask, the digits come from a table so there are no branches
+static char *jsonWriteMask(char *p, unsigned int mask)
+{
+    memcpy(p, maskText[mask], 4); // always copy 4 bytes, the buffer has room for them
+    return p + maskTextLength[mask];
+}
+
+// Write board and game state as JSON
+// returns the length of the text (without the terminating 0), or -1 if buf is too small
+int boardToJson(const struct sudoku_board *b, const struct game_state *game, char *buf, int size)
+{
+    // the longest possible text: fixed keys, two grids, 81 candidates of 4 digits and the numbers
+    char scratch[1024];
+    char *p = size >= (int)sizeof(scratch) ? buf : scratch;
+    char *start = p;
+    unsigned short cand[N * N];
+
+    JSON_LITERAL(p, "{\"difficulty\":\"");
+    const char *name = difficultyName(game->difficulty);
+    int nameLength = (int)strlen(name);
+    memcpy(p, name, nameLength);
+    p += nameLength;
+    JSON_LITERAL(p, "\",\"attempts\":");
+    p = jsonWriteInt(p, (unsigned int)game->attempts);
+    JSON_LITERAL(p, ",\"seed\":");
+    p = jsonWriteInt(p, game->seed);
+    JSON_LITERAL(p, ",\"emptyCells\":");
+    p = jsonWriteInt(p, (unsigned int)b->emptyCells);
+    JSON_LITERAL(p, ",\"unsolved\":");
+    p = jsonWriteGrid(p, b->unsolved);
+    JSON_LITERAL(p, ",\"solved\":");
+    p = jsonWriteGrid(p, b->solved);
+    JSON_LITERAL(p, ",\"candidates\":[");
+    boardCandidates(b->unsolved, cand);
+    for (int c = 0; c < N * N; c++)
+    {
+        p = jsonWriteMask(p, cand[c]);
+        *p++ = ',';
+    }
+    p[-1] = ']'; // replaces the last comma
+    JSON_LITERAL(p, "}");
+    *p = 0;
+
+    int length = (int)(p - start);
+    if (start == scratch)
+    {
+        if (length >= size)
+            return -1; // caller's buffer is too small
+        memcpy(buf, scratch, length + 1);
+    }
+    return length;
+}
+
+// JSON reader position
+struct json_reader {
+    const char *p;      // next character
+    const char *end;    // end of the text
+};
+
+// skip white space
+static void jsonSkipSpace(struct json_reader *r)
+{
+    while (r->p < r->end && (*r->p == ' ' || *r->p == '\t' || *r->p == '\n' || *r->p == '\r'))
+        r->p++;
+}
+
+// expect the given character after white space
+static bool jsonExpect(struct json_reader *r, char c)
+{
+    jsonSkipSpace(r);
+    if (r->p >= r->end || *r->p != c)
+        return false;
+    r->p++;
+    return true;
+}
+
+// read a string without escapes, returns its start and length
+static bool jsonReadString(struct json_reader *r, const char **text, int *length)
+{
+    if (!jsonExpect(r, '"'))
+        return false;
+    *text = r->p;
+    while (r->p < r->end && *r->p != '"')
+    {
+        if (*r->p == '\\')
+            r->p++; // skip the escaped character
+        r->p++;
+    }
+    if (r->p >= r->end)
+        return false;
+    *length = (int)(r->p - *text);
+    r->p++; // closing quote
+    return true;
+}
+
+// read a non negative integer
+static bool jsonReadInt(struct json_reader *r, unsigned int *value)
+{
+    jsonSkipSpace(r);
+    if (r->p >= r->end || *r->p < '0' || *r->p > '9')
+        return false;
+    unsigned long long v = 0;
+    while (r->p < r->end && *r->p >= '0' && *r->p <= '9')
+    {
+        v = v * 10 + (unsigned int)(*r->p++ - '0');
+        if (v > 0xFFFFFFFFULL)
+            return false;
+    }
+    *value = (unsigned int)v;
+    return true;
+}
+
+// read a grid string of 81 digits
+static bool jsonReadGrid(struct json_reader *r, int grid[N][N])
+{
+    unsigned int bad = 0;
+    if (!jsonExpect(r, '"') || r->end - r->p < N * N + 1)
+        return false;
+
+    const char *text = r->p;
+    for (int i = 0; i < N; i++)
+    {
+        for (int j = 0; j < N; j++)
+        {
+            unsigned int digit = (unsigned int)(*text++ - '0');
+            bad |= digit > 9; // checked once after the loop
+            grid[i][j] = (int)digit;
+        }
+    }
+    r->p = text + 1;
+    return !bad && *text == '"';
+}
+
+// skip any value, used for unknown keys and for the derived candidates
+static bool jsonSkipValue(struct json_reader *r)
+{
+    jsonSkipSpace(r);
+    if (r->p >= r->end)
+        return false;
+
+    const char *text;
+    int length, depth = 0;
+    switch (*r->p)
+    {
+    case '"':
+        return jsonReadString(r, &text, &length);
+    case '[':
+    {
+        // plain arrays like the candidates are skipped with vectorized library scans
+        const char *close = memchr(r->p, ']', r->end - r->p);
+        if (close != NULL && memchr(r->p + 1, '[', close - r->p - 1) == NULL &&
+            memchr(r->p, '{', close - r->p) == NULL && memchr(r->p, '"', close - r->p) == NULL)
+        {
+            r->p = close + 1;
+            return true;
+        }
+        // fall through to the generic skip for nested arrays
+    }
+    /* fall through */
+    case '{':
+        // skip nested objects and arrays by counting brackets, strings may hold brackets
+        do
+        {
+            if (*r->p == '"')
+            {
+                if (!jsonReadString(r, &text, &length))
+                    return false;
+                continue;
+            }
+            if (*r->p == '{' || *r->p == '[')
+                depth++;
+            else if (*r->p == '}' || *r->p == ']')
+                depth--;
+            r->p++;
+        } while (depth > 0 && r->p < r->end);
+        return depth == 0;
+    default:
+    {
+        // numbers, true, false and null, a missing value like {"x":} is an error
+        const char *start = r->p;
+        while (r->p < r->end && *r->p != ',' && *r->p != '}' && *r->p != ']' &&
+               *r->p != ' ' && *r->p != '\n' && *r->p != '\r' && *r->p != '\t')
+            r->p++;
+        return r->p != start;
+    }
+    }
+}
+
+// Read board and game state from JSON
+// returns false if the text is not a valid board, b and game may then be partly filled
+bool boardFromJson(const char *json, int length, struct sudoku_board *b, struct game_state *game)
+{
+    struct json_reader r = {json, json + length};
+    bool hasUnsolved = false, hasSolved = false, hasEmptyCells = false;
+
+    if (!jsonExpect(&r, '{'))
+        return false;
+    jsonSkipSpace(&r);
+    if (r.p < r.end && *r.p == '}')
+        return false; // empty object has no grids
+
+    do
+    {
+        const char *key, *text;
+        int keyLength, textLength;
+        unsigned int value;
+
+        if (!jsonReadString(&r, &key, &keyLength) || !jsonExpect(&r, ':'))
+            return false;
+
+        if (keyLength == 10 && memcmp(key, "difficulty", 10) == 0)
+        {
+            if (!jsonReadString(&r, &text, &textLength))
+                return false;
+            game->difficulty = difficultyFromName(text, textLength);
+        }
+        else if (keyLength == 8 && memcmp(key, "attempts", 8) == 0)
+        {
+            if (!jsonReadInt(&r, &value))
+                return false;
+            game->attempts = (int)value;
+        }
+        else if (keyLength == 4 && memcmp(key, "seed", 4) == 0)
+        {
+            if (!jsonReadInt(&r, &game->seed))
+                return false;
+        }
+        else if (keyLength == 10 && memcmp(key, "emptyCells", 10) == 0)
+        {
+            if (!jsonReadInt(&r, &value) || value > N * N)
+                return false;
+            b->emptyCells = (int)value;
+            hasEmptyCells = true;
+        }
+        else if (keyLength == 8 && memcmp(key, "unsolved", 8) == 0)
+        {
+            if (!jsonReadGrid(&r, b->unsolved))
+                return false;
+            hasUnsolved = true;
+        }
+        else if (keyLength == 6 && memcmp(key, "solved", 6) == 0)
+        {
+            if (!jsonReadGrid(&r, b->solved))
+                return false;
+            hasSolved = true;
+        }
+        else if (!jsonSkipValue(&r))
+            return false;
+    } while (jsonExpect(&r, ','));
+
+    if (!jsonExpect(&r, '}') || !hasUnsolved || !hasSolved)
+        return false;
+
+    if (!hasEmptyCells)
+    {
+        b->emptyCells = 0; // counted from the puzzle
+        for (int cell = 0; cell < N * N; cell++)
+            b->emptyCells += b->unsolved[cell / N][cell % N] == 0;
+    }
+    // custom levels are known by their number of empty cells
+    if (game->difficulty < 0)
+        game->difficulty = b->emptyCells;
+    return true;
+}
+
+// Benchmark JSON encoding and decoding
+void benchmarkJson(int count)
+{
+    struct sudoku_board decoded;
+    struct game_state game = {0}, readGame = {0};
+    char text[1024];
+    int length = 0;
+
+    newGame(&board, &game, HARD_LVL, (unsigned int)time(NULL));
+    game.attempts = 7;
+
+    long long start = nowNanoseconds();
+    for (int r = 0; r < count; r++)
+    {
+        game.attempts = r & 0xFF; // keep the compiler from hoisting the call
+        length = boardToJson(&board, &game, text, sizeof(text));
+    }
+    long long encoded = nowNanoseconds();
+    bool ok = true;
+    for (int r = 0; r < count; r++)
+        ok &= boardFromJson(text, length, &decoded, &readGame);
+    long long end = nowNanoseconds();
+
+    if (!ok || memcmp(decoded.unsolved, board.unsolved, sizeof(board.unsolved)) != 0 ||
+        memcmp(decoded.solved, board.solved, sizeof(board.solved)) != 0 || readGame.seed != game.seed)
+    {
+        printf("Round trip failed!\n");
+        return;
+    }
+
+    printf("JSON size: %d bytes\n", length);
+    printf("Encode: %.0f ns per board (%.2f million boards per second)\n",
+           (double)(encoded - start) / count, count / ((encoded - start) / 1000.0));
+    printf("Decode: %.0f ns per board (%.2f million boards per second)\n",
+           (double)(end - encoded) / count, count / ((end - encoded) / 1000.0));
+}
+
+
+/* =========== Game Logic =========== */
+
+// The path and the planes are only allocated when a game needs them, so a game in checked
+// entry without hints stays small enough to keep millions of them in a session pool.
+
+// reset the game state for the board of a new game, the entry mode is kept
+static void gameStart(const struct sudoku_board *b, struct game_state *game, int difficulty, unsigned int seed)
+{
+    game->difficulty = difficulty;
+    game->attempts = 0;
+    game->seed = seed;
+    game->moves = 0;
+    if (game->path != NULL)
+        game->path->count = 0; // the old path does not fit the new board
+    if (game->planes != NULL)
+        planesInit(game->planes, b->unsolved);
+}
+
+// Switch free entry on or off, false if there is no memory for the planes
+bool gameFreeEntry(const struct sudoku_board *b, struct game_state *game, bool on)
+{
+    if (!on)
+    {
+        free(game->planes);
+        game->planes = NULL;
+        return true;
+    }
+    if (game->planes == NULL && (game->planes = malloc(sizeof(struct candidate_planes))) == NULL)
+        return false;
+    planesInit(game->planes, b->unsolved);
+    return true;
+}
+
+// Record the solve path of the board for hints, false if there is no memory for it
+bool gameRecordPath(const struct sudoku_board *b, struct game_state *game)
+{
+    if (game->path == NULL && (game->path = malloc(sizeof(struct solve_path))) == NULL)
+        return false;
+    solvePath(b->unsolved, b->solved, game->path);
+    return true;
+}
+
+// Free the path and the planes of a game, it goes back to checked entry without hints
+void gameFree(struct game_state *game)
+{
+    free(game->path);
+    free(game->planes);
+    game->path = NULL;
+    game->planes = NULL;
+}
+
+// Generate a board for a new game
+// the board is generated in the global board and copied to b, game must have been zeroed
+// before its first game, the path and the planes it owns are kept
+void newGame(struct sudoku_board *b, struct game_state *game, int difficulty, unsigned int seed)
+{
+    seedRandom(seed); // the same seed always gives the same board
+    resetBoard();
+    board.emptyCells = difficulty;
+    fillValues();
+    if (b != &board)
+        *b = board;
+    gameStart(b, game, difficulty, seed);
+}
+
+// Start a game on a given puzzle and its solution, like newGame() without generating
+void loadGame(struct sudoku_board *b, struct game_state *game, const int puzzle[N][N], const int solution[N][N])
+{
+    memcpy(b->unsolved, puzzle, sizeof(b->unsolved));
+    memcpy(b->solved, solution, sizeof(b->solved));
+    b->emptyCells = 0;
+    for (int cell = 0; cell < N * N; cell++)
+        b->emptyCells += puzzle[cell / N][cell % N] == 0;
+    gameStart(b, game, b->emptyCells, 0);
+}
+
+// Validate a move and put the value in the cell if it matches the solution
+// row and col start from 0, the number of attempts counts every value in range
+int applyMove(struct sudoku_board *b, struct game_state *game, int row, int col, int num)
+{
+    if (row < 0 || row >= N || col < 0 || col >= N || num < 1 || num > N)
+        return MOVE_INVALID;
+    if (b->unsolved[row][col] != 0)
+        return MOVE_FILLED;
+
+    game->attempts++; // increment the number of attempts
+    if (game->planes != NULL)
+    {
+        // any digit the peers leave open goes in, then look ahead for a dead end
+        if (!(game->planes->cells[row * N + col] & (1 << num)))
+            return MOVE_WRONG;
+        b->unsolved[row][col] = num;
+        b->emptyCells--;
+        game->journal[game->moves++] = (unsigned char)(row * N + col);
+        planesPlace(game->planes, row * N + col, num);
+        TRACE4(move, row, col, num, game->attempts); // probe: a value was put in a cell
+        return planesDeadEnd(game->planes, DEAD_END_BUDGET) ? MOVE_DEAD_END : MOVE_ACCEPTED;
+    }
+    if (b->solved[row][col] != num)
+        return MOVE_WRONG;
+
+    b->unsolved[row][col] = num;
+    b->emptyCells--;
+    game->journal[game->moves++] = (unsigned char)(row * N + col);
+    TRACE4(move, row, col, num, game->attempts); // probe: a value was put in a cell
+    return MOVE_ACCEPTED;
+}
+
+// Take back the last accepted value, row and col are set to its cell
+bool undoMove(struct sudoku_board *b, struct game_state *game, int *row, int *col)
+{
+    if (game->moves == 0)
+        return false; // nothing to undo
+
+    int cell = game->journal[--game->moves];
+    *row = cell / N;
+    *col = cell % N;
+    b->unsolved[*row][*col] = 0;
+    b->emptyCells++;
+    if (game->planes != NULL)
+        planesInit(game->planes, b->unsolved); // eliminations cannot be taken back one by one
+    return true;
+}
+
+
+/* =========== Line Protocol =========== */
+
+// With --protocol the game is driven by one command per line on stdin and every command
+// gets exactly one reply line on stdout. Rows and columns start from 1.
+//   NEW <easy|medium|hard|cells> [seed]   -> OK <seed>, cells from 0 to MAX_EMPTY_CELLS
+//   LOAD <puzzle> <solution> [path]       -> OK <empty cells>, a line of a bank written by
+//                                            --generate, hints come from its path if it has one
+//   MOVE <row> <col> <value>              -> OK | OK SOLVED | WRONG | FILLED | INVALID
+//   UNDO                                  -> OK <row> <col>
+//   HINT                                  -> HINT <row> <col> <value> <technique>
+//   EXPLAIN <row> <col>                   -> STEP <index> <technique> <row> <col> <value>
+//   MODE <free|checked>                   -> OK, free entry takes any digit the peers allow
+//                                            and MOVE replies DEADEND once there is no completion
+//   SUBMIT <81 digits>                    -> OK SOLVED | WRONG, UNDO takes the cells back
+//   BOARD                                 -> BOARD <81 digits, 0 for empty cells>
+//   STATE                                 -> the board and game state as JSON
+//   QUIT                                  -> BYE
+// Errors are replied as ERR <reason>.
+
+#define PROTOCOL_BUFFER 65536   // size of the input and output buffers
+#define PROTOCOL_REPLY 1024     // longest reply line
+
+// split the next space separated word off the line
+static char *protocolWord(char **line)
+{
+    char *p = *line;
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+        p++;
+    char *word = p;
+    while (*p != 0 && *p != ' ' && *p != '\t' && *p != '\r')
+        p++;
+    if (*p != 0)
+        *p++ = 0;
+    *line = p;
+    return word;
+}
+
+// value of a hex digit, -1 if the character is not one
+static int protocolHex(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+// read a number word, returns false if the word is not a number
+static bool protocolNumber(char **line, long *value)
+{
+    char *word = protocolWord(line), *end;
+    *value = strtol(word, &end, 10);
+    return *word != 0 && *end == 0;
+}
+
+// Run one protocol command, line must not hold the line break
+// returns the length of the reply written to reply, including its line break
+int protocolCommand(struct sudoku_board *b, struct game_state *game, char *line, char *reply)
+{
+    char *command = protocolWord(&line);
+    long row, col, num;
+    int r, c;
+
+    if (strcmp(command, "NEW") == 0)
+    {
+        char *level = protocolWord(&line);
+        int difficulty = difficultyFromName(level, (int)strlen(level));
+        long seed;
+        if (difficulty < 0)
+        {
+            char *end;
+            difficulty = (int)strtol(level, &end, 10);
+            if (*level == 0 || *end != 0 || difficulty < 0 || difficulty > MAX_EMPTY_CELLS)
+                return sprintf(reply, "ERR unknown level\n");
+        }
+        if (!protocolNumber(&line, &seed))
+            seed = (long)time(NULL); // no seed given
+        newGame(b, game, difficulty, (unsigned int)seed);
+        gameRecordPath(b, game); // hints are looked up from now on
+        return sprintf(reply, "OK %u\n", game->seed);
+    }
+    if (strcmp(command, "LOAD") == 0)
+    {
+        char *digits = protocolWord(&line), *solved = protocolWord(&line), *hex = protocolWord(&line);
+        int puzzle[N][N], solution[N][N], length = (int)strlen(hex) / 2;
+        unsigned char bytes[4 * SOLVE_PATH_STEPS] = {0};
+        struct solve_path path;
+        if (strlen(digits) != N * N || strlen(solved) != N * N || strlen(hex) % 2 != 0 || length > (int)sizeof(bytes))
+            return sprintf(reply, "ERR usage LOAD <81 digits> <81 digits> [path]\n");
+        for (int cell = 0; cell < N * N; cell++)
+        {
+            puzzle[cell / N][cell % N] = digits[cell] >= '1' && digits[cell] <= '9' ? digits[cell] - '0' : 0;
+            solution[cell / N][cell % N] = solved[cell] - '0';
+        }
+        if (!validateGrid(solution, puzzle))
+            return sprintf(reply, "ERR solution does not fit\n");
+
+        // the stored path is read back instead of solving again, every digit it places must fit
+        bool ok = true;
+        for (int k = 0; k < length && ok; k++)
+        {
+            int high = protocolHex(hex[2 * k]), low = protocolHex(hex[2 * k + 1]);
+            ok = high >= 0 && low >= 0;
+            bytes[k] = (unsigned char)(high << 4 | low);
+        }
+        ok = ok && (length == 0 || pathDecode(bytes, length, &path));
+        for (int k = 0; ok && length > 0 && k < path.count; k++)
+        {
+            int cell = path.steps[k] & PATH_NO_CELL;
+            ok = cell == PATH_NO_CELL || (puzzle[cell / N][cell % N] == 0 &&
+                                          (int)(path.steps[k] >> 7 & 15) == solution[cell / N][cell % N]);
+        }
+        if (!ok)
+            return sprintf(reply, "ERR bad path\n");
+        loadGame(b, game, puzzle, solution);
+        if (length == 0)
+            gameRecordPath(b, game);
+        else if (game->path != NULL || (game->path = malloc(sizeof(path))) != NULL)
+            *game->path = path;
+        return sprintf(reply, "OK %d\n", b->emptyCells);
+    }
+    if (strcmp(command, "QUIT") == 0)
+        return sprintf(reply, "BYE\n");
+    if (strcmp(command, "MODE") == 0)
+    {
+        char *mode = protocolWord(&line);
+        if (strcmp(mode, "free") != 0 && strcmp(mode, "checked") != 0)
+            return sprintf(reply, "ERR usage MODE <free|checked>\n");
+        if (!gameFreeEntry(b, game, mode[0] == 'f'))
+            return sprintf(reply, "ERR out of memory\n");
+        return sprintf(reply, "OK\n");
+    }
+    if (strcmp(command, "MOVE") != 0 && strcmp(command, "UNDO") != 0 && strcmp(command, "HINT") != 0 &&
+        strcmp(command, "BOARD") != 0 && strcmp(command, "STATE") != 0 && strcmp(command, "SUBMIT") != 0 &&
+        strcmp(command, "EXPLAIN") != 0)
+        return sprintf(reply, "ERR unknown command\n");
+    if (b->solved[0][0] == 0)
+        return sprintf(reply, "ERR no game\n"); // a solved board has no empty cell
+
+    switch (command[0])
+    {
+    case 'M': // MOVE
+        if (!protocolNumber(&line, &row) || !protocolNumber(&line, &col) || !protocolNumber(&line, &num))
+            return sprintf(reply, "ERR usage MOVE <row> <col> <value>\n");
+        switch (applyMove(b, game, (int)row - 1, (int)col - 1, (int)num))
+        {
+        case MOVE_ACCEPTED:
+            return b->emptyCells == 0 ? sprintf(reply, "OK SOLVED\n") : sprintf(reply, "OK\n");
+        case MOVE_WRONG:
+            return sprintf(reply, "WRONG\n");
+        case MOVE_FILLED:
+            return sprintf(reply, "FILLED\n");
+        case MOVE_DEAD_END:
+            return sprintf(reply, "DEADEND\n");
+        default:
+            return sprintf(reply, "INVALID\n");
+        }
+    case 'U': // UNDO
+        if (!undoMove(b, game, &r, &c))
+            return sprintf(reply, "ERR nothing to undo\n");
+        if (game->path != NULL && game->path->stepOfCell[r * N + c] < game->path->cursor)
+            game->path->cursor = game->path->stepOfCell[r * N + c]; // the cell can be hinted again
+        return sprintf(reply, "OK %d %d\n", r + 1, c + 1);
+    case 'E': // EXPLAIN, the step of the path that places a cell
+        if (!protocolNumber(&line, &row) || !protocolNumber(&line, &col) || row < 1 || row > N || col < 1 || col > N)
+            return sprintf(reply, "ERR usage EXPLAIN <row> <col>\n");
+        if (game->path == NULL || (r = game->path->stepOfCell[(row - 1) * N + col - 1]) >= game->path->count)
+            return sprintf(reply, "ERR no step\n"); // a clue, or no path
+        return sprintf(reply, "STEP %d %s %ld %ld %d\n", r, techniqueName((game->path->steps[r] >> 11) & 15), row, col,
+                       b->solved[row - 1][col - 1]);
+    case 'H': // HINT, the next step of the path, or else the first empty cell from the top left
+        if (game->path != NULL && (r = pathNextHint(game->path, b->unsolved)) >= 0)
+        {
+            int cell = game->path->steps[r] & PATH_NO_CELL;
+            return sprintf(reply, "HINT %d %d %d %s\n", cell / N + 1, cell % N + 1, b->solved[cell / N][cell % N],
+                           techniqueName((game->path->steps[r] >> 11) & 15));
+        }
+        for (int cell = 0; cell < N * N; cell++)
+        {
+            if (b->unsolved[cell / N][cell % N] == 0)
+                return sprintf(reply, "HINT %d %d %d\n", cell / N + 1, cell % N + 1, b->solved[cell / N][cell % N]);
+        }
+        return sprintf(reply, "ERR solved\n");
+    case 'B': // BOARD
+        memcpy(reply, "BOARD ", 6);
+        for (int cell = 0; cell < N * N; cell++)
+            reply[6 + cell] = (char)('0' + b->unsolved[cell / N][cell % N]);
+        reply[6 + N * N] = '\n';
+        return 6 + N * N + 1;
+    case 'S': // SUBMIT or STATE
+        if (command[1] == 'U')
+        {
+            // any completed grid that keeps the filled cells is accepted, not only the stored solution
+            char *digits = protocolWord(&line);
+            int grid[N][N];
+            if (strlen(digits) != N * N)
+                return sprintf(reply, "ERR usage SUBMIT <81 digits>\n");
+            for (int cell = 0; cell < N * N; cell++)
+                grid[cell / N][cell % N] = digits[cell] - '0';
+            if (!validateGrid(grid, b->unsolved))
+                return sprintf(reply, "WRONG\n");
+            // the cells filled by the grid go into the journal, so UNDO takes them back one by one
+            for (int cell = 0; cell < N * N; cell++)
+                if (b->unsolved[cell / N][cell % N] == 0)
+                    game->journal[game->moves++] = (unsigned char)cell;
+            memcpy(b->unsolved, grid, sizeof(grid));
+            b->emptyCells = 0;
+            if (game->planes != NULL)
+                planesInit(game->planes, b->unsolved);
+            return sprintf(reply, "OK SOLVED\n");
+        }
+        /* fall through */
+    default: // STATE
+        r = boardToJson(b, game, reply, PROTOCOL_REPLY - 1);
+        reply[r] = '\n';
+        return r + 1;
+    }
+}
+
+// Serve the line protocol on stdin and stdout
+// input is read in large chunks and all replies to one chunk are written at once,
+// so a pipe full of commands costs only a few system calls
+int runProtocol()
+{
+    static char in[PROTOCOL_BUFFER], out[PROTOCOL_BUFFER];
+    struct sudoku_board b = {0};
+    struct game_state game = {0};
+    int length = 0, outLength = 0;
+    bool quit = false, failed = false;
+
+    while (!quit && !failed)
+    {
+        ssize_t got = read(STDIN_FILENO, in + length, sizeof(in) - length - 1);
+        if (got <= 0)
+            break; // end of input or error
+        length += (int)got;
+
+        // run every complete line of the chunk
+        char *line = in, *end = in + length, *newline;
+        while (!quit && (newline = memchr(line, '\n', end - line)) != NULL)
+        {
+            *newline = 0;
+            if (outLength > PROTOCOL_BUFFER - PROTOCOL_REPLY)
+            {
+                failed = write(STDOUT_FILENO, out, outLength) != outLength;
+                outLength = 0;
+            }
+            if (line != newline) // skip empty lines
+            {
+                int replyLength = protocolCommand(&b, &game, line, out + outLength);
+                quit = memcmp(out + outLength, "BYE", 3) == 0;
+                outLength += replyLength;
+            }
+            line = newline + 1;
+        }
+
+        // keep the incomplete last line for the next read
+        length = (int)(end - line);
+        memmove(in, line, length);
+        if (length == (int)sizeof(in) - 1)
+            length = 0; // a line longer than the buffer is dropped
+
+        if (outLength > 0 && write(STDOUT_FILENO, out, outLength) != outLength)
+            failed = true;
+        outLength = 0;
+    }
+    gameFree(&game);
+    return failed ? 1 : 0;
+}
+
+// Benchmark the protocol command processing without the pipe
+void benchmarkProtocol(int count)
+{
+    static const char *commands[] = {"MOVE 1 1 1", "HINT", "UNDO", "BOARD", "MOVE 9 9 5"};
+    struct sudoku_board b = {0};
+    struct game_state game = {0};
+    char line[64], reply[PROTOCOL_REPLY];
+    long long bytes = 0;
+
+    sprintf(line, "NEW hard %u", (unsigned int)time(NULL));
+    protocolCommand(&b, &game, line, reply);
+
+    long long start = nowNanoseconds();
+    for (int r = 0; r < count; r++)
+    {
+        strcpy(line, commands[r % 5]); // commands are split in place
+        bytes += protocolCommand(&b, &game, line, reply);
+    }
+    long long end = nowNanoseconds();
+
+    gameFree(&game);
+    printf("Ran %d commands, %lld bytes of replies\n", count, bytes);
+    printf("%.0f ns per command (%.2f million commands per second)\n",
+           (double)(end - start) / count, count / ((end - start) / 1000.0));
+}
+
+
+/* =========== Self Play Bots =========== */
+
+// Bots play generated games through applyMove(), the same path the interactive game uses.
+// Every thread keeps many games open and moves in them round robin, so thousands of
+// games are played at the same time. Options (name=value):
+//   threads  number of threads (default: number of cores)
+//   games    number of games open at the same time over all threads (default 1000)
+//   rounds   number of games every open game slot plays one after another (default 1)
+//   error    chance of a wrong value per move, from 0 to 1 (default 0.1)
+//   think    mean think time per move in milliseconds, 0 for no delay (default 0)
+
+// Latency histogram with power of two buckets, bucket k holds values below 2^k ns
+struct latency_histogram {
+    long long counts[LATENCY_BUCKETS];
+    long long total;    // number of values
+    long long sum;      // sum of values in ns
+};
+
+// Game played by a bot
+struct bot_game {
+    struct sudoku_board board;
+    struct game_state game;
+    long long nextMove;     // time of the next move in ns, when thinking
+    int roundsLeft;         // games still to play in this slot
+};
+
+// Work and results of one bot thread
+struct bot_thread {
+    pthread_t thread;
+    int games;              // number of open games
+    int rounds;             // games per slot
+    double error;           // chance of a wrong value
+    long long think;        // mean think time in ns
+    unsigned int seed;      // seed of the first game
+    long long moves;        // moves made
+    long long finished;     // games solved
+    bool failed;            // no memory for the games, the thread played none
+    struct latency_histogram moveLatency;   // time spent in applyMove()
+    struct latency_histogram newLatency;    // time spent generating a game
+};
+
+// Value of a name=value option, fallback if the option is not given
+double optionNumber(int argc, char *argv[], const char *name, double fallback)
+{
+    size_t length = strlen(name);
+    for (int a = 1; a < argc; a++)
+    {
+        if (strncmp(argv[a], name, length) == 0 && argv[a][length] == '=')
+            return atof(argv[a] + length + 1);
+    }
+    return fallback;
+}
+
+// Number of empty cells of the level= option, a level name or a number like in --live and NEW
+// -1 if it is neither, atof() would read a name as 0 and make puzzles without empty cells
+int optionLevel(int argc, char *argv[], int fallback)
+{
+    for (int a = 1; a < argc; a++)
+    {
+        if (strncmp(argv[a], "level=", 6) != 0)
+            continue;
+        const char *level = argv[a] + 6;
+        int difficulty = difficultyFromName(level, (int)strlen(level));
+        if (difficulty >= 0)
+            return difficulty;
+        char *end;
+        long cells = strtol(level, &end, 10);
+        return *level == 0 || *end != 0 || cells < 0 || cells > MAX_EMPTY_CELLS ? -1 : (int)cells;
+    }
+    return fallback;
+}
+
+// add a value to a latency histogram
+static void latencyRecord(struct latency_histogram *h, long long ns)
+{
+    int bucket = ns > 0 ? 64 - __builtin_clzll((unsigned long long)ns) : 0;
+    h->counts[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+    h->total++;
+    h->sum += ns;
+}
+
+// upper bound of the bucket holding the given fraction of the values
+static long long latencyPercentile(const struct latency_histogram *h, double fraction)
+{
+    long long seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        seen += h->counts[bucket];
+        if (seen >= fraction * h->total)
+            return 1LL << bucket;
+    }
+    return 1LL << (LATENCY_BUCKETS - 1);
+}
+
+// print a latency histogram
+static void latencyPrint(const char *name, const struct latency_histogram *h)
+{
+    if (h->total == 0)
+        return;
+    printf("%s latency: mean %.0f ns, p50 < %lld ns, p99 < %lld ns, p99.9 < %lld ns\n", name,
+           (double)h->sum / h->total, latencyPercentile(h, 0.5), latencyPercentile(h, 0.99),
+           latencyPercentile(h, 0.999));
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        if (h->counts[bucket] != 0)
+            printf("  < %12lld ns: %lld\n", 1LL << bucket, h->counts[bucket]);
+    }
+}
+
+// start the next game of a bot slot
+static void botNewGame(struct bot_thread *t, struct bot_game *g)
+{
+    static const int levels[] = {EASY_LVL, MEDIUM_LVL, HARD_LVL};
+    long long start = nowNanoseconds();
+    newGame(&g->board, &g->game, levels[randomGenerator(3) - 1], t->seed++);
+    latencyRecord(&t->newLatency, nowNanoseconds() - start);
+    g->roundsLeft--;
+}
+
+// make one move like a player would: pick an empty cell and mostly the right value
+static void botMove(struct bot_thread *t, struct bot_game *g)
+{
+    int cell = randomGenerator(N * N) - 1;
+    while (g->board.unsolved[cell / N][cell % N] != 0)
+        cell = (cell + 1) % (N * N); // first empty cell from a random start
+
+    int row = cell / N, col = cell % N, num = g->board.solved[row][col];
+    if (randomGenerator(1000000) <= t->error * 1000000)
+        num = (num - 1 + randomGenerator(N - 1)) % N + 1; // any other digit
+
+    long long start = nowNanoseconds();
+    applyMove(&g->board, &g->game, row, col, num);
+    latencyRecord(&t->moveLatency, nowNanoseconds() - start);
+    t->moves++;
+}
+
+// thread function of a bot thread
+static void *botThread(void *arg)
+{
+    struct bot_thread *t = arg;
+    struct bot_game *games = calloc(t->games, sizeof(struct bot_game));
+    int open = t->games;
+
+    if (games == NULL)
+    {
+        t->failed = true;
+        return NULL;
+    }
+    for (int g = 0; g < t->games; g++)
+    {
+        games[g].roundsLeft = t->rounds;
+        botNewGame(t, &games[g]);
+    }
+
+    while (open > 0)
+    {
+        long long now = nowNanoseconds(), wake = now + 1000000000LL;
+        for (int g = 0; g < t->games; g++)
+        {
+            struct bot_game *game = &games[g];
+            if (game->board.emptyCells == 0 && game->roundsLeft == 0)
+                continue; // slot is done
+            if (game->nextMove > now)
+            {
+                if (game->nextMove < wake)
+                    wake = game->nextMove; // still thinking
+                continue;
+            }
+
+            botMove(t, game);
+            if (game->board.emptyCells == 0)
+            {
+                t->finished++;
+                if (game->roundsLeft > 0)
+                    botNewGame(t, game);
+                else
+                    open--;
+            }
+            if (t->think > 0)
+            {
+                // think between half and one and a half of the mean time
+                game->nextMove = now + t->think / 2 + (long long)randomGenerator(1000) * t->think / 1000;
+                if (game->nextMove < wake)
+                    wake = game->nextMove;
+            }
+        }
+
+        if (t->think > 0 && open > 0 && wake > nowNanoseconds())
+        {
+            long long sleep = wake - nowNanoseconds();
+            struct timespec ts = {sleep / 1000000000LL, sleep % 1000000000LL};
+            nanosleep(&ts, NULL);
+        }
+    }
+    free(games);
+    return NULL;
+}
+
+// Play generated games with bots and report the engine speed
+int runBots(int argc, char *argv[])
+{
+    int threads = (int)optionNumber(argc, argv, "threads", (double)sysconf(_SC_NPROCESSORS_ONLN));
+    int games = (int)optionNumber(argc, argv, "games", 1000);
+    int rounds = (int)optionNumber(argc, argv, "rounds", 1);
+    double error = optionNumber(argc, argv, "error", 0.1);
+    double think = optionNumber(argc, argv, "think", 0);
+
+    if (threads < 1 || games < threads || rounds < 1 || error < 0 || error > 1 || think < 0)
+    {
+        printf("Invalid bot options!\n");
+        return 1;
+    }
+
+    struct bot_thread *bots = calloc(threads, sizeof(struct bot_thread));
+    if (bots == NULL)
+        return 1;
+
+    unsigned int seed = (unsigned int)time(NULL);
+    long long start = nowNanoseconds();
+    int started = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        bots[t].games = games / threads + (t < games % threads);
+        bots[t].rounds = rounds;
+        bots[t].error = error;
+        bots[t].think = (long long)(think * 1000000);
+        bots[t].seed = seed + (unsigned int)t * 1000003u; // different games in every thread
+        if (pthread_create(&bots[t].thread, NULL, botThread, &bots[t]) != 0)
+            break; // only the threads that started are joined and counted
+        started++;
+    }
+
+    // merge the results of the threads that played
+    struct bot_thread total = {0};
+    int played = 0, open = 0;
+    for (int t = 0; t < started; t++)
+    {
+        pthread_join(bots[t].thread, NULL);
+        if (bots[t].failed)
+            continue;
+        played++;
+        open += bots[t].games;
+        total.moves += bots[t].moves;
+        total.finished += bots[t].finished;
+        for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+        {
+            total.moveLatency.counts[bucket] += bots[t].moveLatency.counts[bucket];
+            total.newLatency.counts[bucket] += bots[t].newLatency.counts[bucket];
+        }
+        total.moveLatency.total += bots[t].moveLatency.total;
+        total.moveLatency.sum += bots[t].moveLatency.sum;
+        total.newLatency.total += bots[t].newLatency.total;
+        total.newLatency.sum += bots[t].newLatency.sum;
+    }
+    double seconds = (nowNanoseconds() - start) / 1e9;
+    free(bots);
+
+    if (played < threads)
+        printf("Only %d of %d bot threads could play!\n", played, threads);
+    if (played == 0)
+        return 1;
+    printf("%d threads played %lld games with %d open at a time in %.2f s\n", played, total.finished, open, seconds);
+    printf("%lld moves, %.0f moves per second, %.0f games per second\n", total.moves,
+           total.moves / seconds, total.finished / seconds);
+    latencyPrint("Move", &total.moveLatency);
+    latencyPrint("Generation", &total.newLatency);
+    return 0;
+}
+
+
+/* =========== Game Sessions =========== */
+
+// A handle is the generation of the session in the high 32 bits and its index in the
+// low 32 bits. Generations start from 1, so 0 is never a valid handle. Sessions are
+// allocated a slab at a time and never move, moves work on the session in place.
+
+// Start a game in a new session, returns its handle or 0 if out of memory
+unsigned long long sessionCreate(struct session_pool *pool, int difficulty, unsigned int seed)
+{
+    if (pool->freeList < 0)
+    {
+        // all sessions are used, add a slab and put its sessions in the free list
+        struct game_session **slabs = realloc(pool->slabs, (pool->slabCount + 1) * sizeof(*slabs));
+        if (slabs == NULL)
+            return 0;
+        pool->slabs = slabs;
+        struct game_session *slab = malloc(SESSION_SLAB * sizeof(struct game_session));
+        if (slab == NULL)
+            return 0;
+        slabs[pool->slabCount] = slab;
+
+        int first = pool->slabCount * SESSION_SLAB;
+        for (int k = 0; k < SESSION_SLAB; k++)
+        {
+            slab[k].generation = 1;
+            slab[k].inUse = false;
+            slab[k].nextFree = k + 1 < SESSION_SLAB ? first + k + 1 : -1;
+        }
+        pool->freeList = first;
+        pool->slabCount++;
+    }
+
+    int index = pool->freeList;
+    struct game_session *session = &pool->slabs[index / SESSION_SLAB][index % SESSION_SLAB];
+    pool->freeList = session->nextFree;
+    pool->used++;
+
+    session->nextFree = -1;
+    session->inUse = true;
+    session->random = ((unsigned long long)seed + 1) * 0x9E3779B97F4A7C15ULL;
+    session->game = (struct game_state){0}; // slabs come from malloc and sessions are reused, start in checked entry
+    newGame(&session->board, &session->game, difficulty, seed);
+    return ((unsigned long long)session->generation << 32) | (unsigned int)index;
+}
+
+// Session of a handle, NULL if the handle is stale
+struct game_session *sessionGet(struct session_pool *pool, unsigned long long handle)
+{
+    unsigned int index = (unsigned int)handle;
+    if (index >= (unsigned int)pool->slabCount * SESSION_SLAB)
+        return NULL;
+    struct game_session *session = &pool->slabs[index / SESSION_SLAB][index % SESSION_SLAB];
+    if (session->generation != (unsigned int)(handle >> 32) || !session->inUse)
+        return NULL; // the last free session also ends the free list, so nextFree cannot tell
+    return session;
+}
+
+// Start the next game of a session, the seed comes from the session's own generator
+// so the games of a session only depend on its first seed
+bool sessionNewGame(struct session_pool *pool, unsigned long long handle, int difficulty)
+{
+    struct game_session *session = sessionGet(pool, handle);
+    if (session == NULL)
+        return false;
+
+    unsigned long long threadState = randomState; // borrow the thread's generator
+    randomState = session->random;
+    unsigned int seed = (unsigned int)randomGenerator(0x7FFFFFFF);
+    session->random = randomState;
+    randomState = threadState;
+
+    newGame(&session->board, &session->game, difficulty, seed);
+    return true;
+}
+
+// Free a session for reuse, returns false if the handle is stale
+bool sessionDestroy(struct session_pool *pool, unsigned long long handle)
+{
+    struct game_session *session = sessionGet(pool, handle);
+    if (session == NULL)
+        return false;
+
+    gameFree(&session->game);
+    session->generation++;
+    if (session->generation == 0)
+        session->generation = 1; // 0 would allow the handle 0
+    session->inUse = false;
+    session->nextFree = pool->freeList;
+    pool->freeList = (int)(unsigned int)handle;
+    pool->used--;
+    return true;
+}
+
+// Free all slabs of a pool, the pool can be used again afterwards
+void sessionPoolFree(struct session_pool *pool)
+{
+    for (int slab = 0; slab < pool->slabCount; slab++)
+    {
+        for (int k = 0; k < SESSION_SLAB; k++)
+            if (pool->slabs[slab][k].inUse)
+                gameFree(&pool->slabs[slab][k].game); // sessions never used hold no game
+        free(pool->slabs[slab]);
+    }
+    free(pool->slabs);
+    pool->slabs = NULL;
+    pool->slabCount = 0;
+    pool->freeList = -1;
+    pool->used = 0;
+}
+
+// Benchmark a session pool: create sessions, play moves in all of them, churn half of them
+void benchmarkSessions(int count)
+{
+    struct session_pool pool = {NULL, 0, -1, 0};
+    unsigned long long *handles = malloc(count * sizeof(*handles));
+    long long moves = 0;
+
+    if (handles == NULL)
+        return;
+
+    long long start = nowNanoseconds();
+    for (int k = 0; k < count; k++)
+        handles[k] = sessionCreate(&pool, HARD_LVL, (unsigned int)k);
+    long long created = nowNanoseconds();
+
+    // every session gets one correct move per round until all are solved
+    bool open = true;
+    while (open)
+    {
+        open = false;
+        for (int k = 0; k < count; k++)
+        {
+            struct game_session *session = sessionGet(&pool, handles[k]);
+            for (int cell = 0; session != NULL && cell < N * N; cell++)
+            {
+                int row = cell / N, col = cell % N;
+                if (session->board.unsolved[row][col] == 0)
+                {
+                    applyMove(&session->board, &session->game, row, col, session->board.solved[row][col]);
+                    moves++;
+                    open = true;
+                    break;
+                }
+            }
+        }
+    }
+    long long played = nowNanoseconds();
+
+    // free every second session and create them again, the slabs are reused
+    int slabs = pool.slabCount;
+    for (int k = 0; k < count; k += 2)
+        sessionDestroy(&pool, handles[k]);
+    for (int k = 0; k < count; k += 2)
+    {
+        if (sessionGet(&pool, handles[k]) != NULL)
+            printf("Stale handle still works!\n");
+        handles[k] = sessionCreate(&pool, EASY_LVL, (unsigned int)k);
+    }
+    long long churned = nowNanoseconds();
+
+    printf("%d sessions of %zu bytes in %d slabs (%d after churn), %.1f MB\n", pool.used,
+           sizeof(struct game_session), slabs, pool.slabCount,
+           pool.slabCount * (double)SESSION_SLAB * sizeof(struct game_session) / 1e6);
+    printf("Create: %.2f us per session (board generation included)\n", (created - start) / 1000.0 / count);
+    printf("Moves: %lld, %.0f ns per move through the handle\n", moves, (double)(played - created) / moves);
+    printf("Churn: %.2f us per destroy and create\n", (churned - played) / 1000.0 / ((count + 1) / 2));
+
+    sessionPoolFree(&pool);
+    free(handles);
+}
+
+
+/* =========== Puzzle Queues =========== */
+
+// The lock free queue is a ring of slots with sequence numbers. A slot at position pos
+// is free for a producer when its sequence is pos, and holds a puzzle for a consumer when
+// its sequence is pos + 1. Producers and consumers claim runs of slots by moving their
+// position with one compare and swap, so a batch costs a single contended operation.
+// Push and pop never block: a short count means the queue is full (backpressure) or
+// empty, and the caller decides whether to wait, drop or slow down.
+
+// Pack a board into a puzzle record
+void puzzleRecordFromBoard(const struct sudoku_board *b, struct puzzle_record *record)
+{
+    for (int i = 0; i < N; i++)
+    {
+        for (int j = 0; j < N; j++)
+        {
+            record->solved[i * N + j] = (unsigned char)b->solved[i][j];
+            record->unsolved[i * N + j] = (unsigned char)b->unsolved[i][j];
+        }
+    }
+}
+
+// Allocate a lock free queue, capacity is rounded up to a power of two
+bool puzzleQueueInit(struct puzzle_queue *q, int capacity)
+{
+    unsigned long long size = 1;
+    while (size < (unsigned long long)capacity)
+        size <<= 1;
+
+    q->slots = aligned_alloc(CACHE_LINE, (size * sizeof(struct puzzle_slot) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+    if (q->slots == NULL)
+        return false;
+    for (unsigned long long pos = 0; pos < size; pos++)
+        atomic_init(&q->slots[pos].sequence, pos);
+    q->mask = size - 1;
+    atomic_init(&q->enqueuePos, 0);
+    atomic_init(&q->dequeuePos, 0);
+    return true;
+}
+
+// Add up to count puzzles, returns how many were added (0 when the queue is full)
+int puzzleQueuePush(struct puzzle_queue *q, const struct puzzle_record *records, int count)
+{
+    unsigned long long pos = atomic_load_explicit(&q->enqueuePos, memory_order_relaxed);
+    while (true)
+    {
+        // count the free slots from pos on
+        int ready = 0;
+        while (ready < count)
+        {
+            unsigned long long seq = atomic_load_explicit(&q->slots[(pos + ready) & q->mask].sequence, memory_order_acquire);
+            if (seq != pos + ready)
+                break;
+            ready++;
+        }
+
+        if (ready == 0)
+        {
+            unsigned long long seq = atomic_load_explicit(&q->slots[pos & q->mask].sequence, memory_order_acquire);
+            if ((long long)(seq - pos) < 0)
+                return 0; // the slot still holds an unread puzzle: full
+            pos = atomic_load_explicit(&q->enqueuePos, memory_order_relaxed); // another producer was faster
+            continue;
+        }
+
+        // claim the free slots, on failure pos is reloaded and we try again
+        if (atomic_compare_exchange_weak_explicit(&q->enqueuePos, &pos, pos + ready,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        {
+            for (int k = 0; k < ready; k++)
+            {
+                struct puzzle_slot *slot = &q->slots[(pos + k) & q->mask];
+                slot->record = records[k];
+                atomic_store_explicit(&slot->sequence, pos + k + 1, memory_order_release);
+            }
+            return ready;
+        }
+    }
+}
+
+// Take up to count puzzles, returns how many were taken (0 when the queue is empty)
+int puzzleQueuePop(struct puzzle_queue *q, struct puzzle_record *records, int count)
+{
+    unsigned long long pos = atomic_load_explicit(&q->dequeuePos, memory_order_relaxed);
+    while (true)
+    {
+        // count the written slots from pos on
+        int ready = 0;
+        while (ready < count)
+        {
+            unsigned long long seq = atomic_load_explicit(&q->slots[(pos + ready) & q->mask].sequence, memory_order_acquire);
+            if (seq != pos + ready + 1)
+                break;
+            ready++;
+        }
+
+        if (ready == 0)
+        {
+            unsigned long long seq = atomic_load_explicit(&q->slots[pos & q->mask].sequence, memory_order_acquire);
+            if ((long long)(seq - (pos + 1)) < 0)
+                return 0; // nothing written yet: empty
+            pos = atomic_load_explicit(&q->dequeuePos, memory_order_relaxed); // another consumer was faster
+            continue;
+        }
+
+        // claim the written slots, on failure pos is reloaded and we try again
+        if (atomic_compare_exchange_weak_explicit(&q->dequeuePos, &pos, pos + ready,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        {
+            for (int k = 0; k < ready; k++)
+            {
+                struct puzzle_slot *slot = &q->slots[(pos + k) & q->mask];
+                records[k] = slot->record;
+                // the slot is free again for the producer one lap later
+                atomic_store_explicit(&slot->sequence, pos + k + q->mask + 1, memory_order_release);
+            }
+            return ready;
+        }
+    }
+}
+
+// Free a lock free queue
+void puzzleQueueFree(struct puzzle_queue *q)
+{
+    free(q->slots);
+    q->slots = NULL;
+}
+
+// Allocate a queue with a mutex, capacity is rounded up to a power of two
+bool lockedQueueInit(struct locked_queue *q, int capacity)
+{
+    unsigned long long size = 1;
+    while (size < (unsigned long long)capacity)
+        size <<= 1;
+
+    q->records = malloc(size * sizeof(struct puzzle_record));
+    if (q->records == NULL)
+        return false;
+    pthread_mutex_init(&q->lock, NULL);
+    q->mask = size - 1;
+    q->head = q->tail = 0;
+    return true;
+}
+
+// Add up to count puzzles, returns how many were added
+int lockedQueuePush(struct locked_queue *q, const struct puzzle_record *records, int count)
+{
+    pthread_mutex_lock(&q->lock);
+    int k = 0;
+    for (; k < count && q->tail - q->head <= q->mask; k++)
+        q->records[q->tail++ & q->mask] = records[k];
+    pthread_mutex_unlock(&q->lock);
+    return k;
+}
+
+// Take up to count puzzles, returns how many were taken
+int lockedQueuePop(struct locked_queue *q, struct puzzle_record *records, int count)
+{
+    pthread_mutex_lock(&q->lock);
+    int k = 0;
+    for (; k < count && q->head != q->tail; k++)
+        records[k] = q->records[q->head++ & q->mask];
+    pthread_mutex_unlock(&q->lock);
+    return k;
+}
+
+// Free a queue with a mutex
+void lockedQueueFree(struct locked_queue *q)
+{
+    pthread_mutex_destroy(&q->lock);
+    free(q->records);
+    q->records = NULL;
+}
+
+// Work of one queue benchmark thread
+struct queue_bench_thread {
+    pthread_t thread;
+    struct puzzle_queue *lockFree;  // queue under test, one of the two is set
+    struct locked_queue *locked;
+    const struct puzzle_record *source;     // puzzle copied by producers
+    long long count;        // puzzles to push or pop
+    int batch;              // puzzles per call
+    bool producer;
+    long long checksum;     // sum of popped digits, checks that puzzles arrive whole
+};
+
+// thread function of the queue benchmark
+static void *queueBenchThread(void *arg)
+{
+    struct queue_bench_thread *t = arg;
+    struct puzzle_record records[64];
+    long long done = 0;
+
+    for (int k = 0; k < t->batch; k++)
+        records[k] = *t->source;
+
+    while (done < t->count)
+    {
+        int want = t->count - done < t->batch ? (int)(t->count - done) : t->batch, got;
+        if (t->producer)
+            got = t->lockFree ? puzzleQueuePush(t->lockFree, records, want) : lockedQueuePush(t->locked, records, want);
+        else
+        {
+            got = t->lockFree ? puzzleQueuePop(t->lockFree, records, want) : lockedQueuePop(t->locked, records, want);
+            for (int k = 0; k < got; k++)
+                t->checksum += records[k].solved[0] + records[k].unsolved[N * N - 1];
+        }
+        if (got == 0)
+            sched_yield(); // full or empty: let the other side run
+        done += got;
+    }
+    return NULL;
+}
+
+// run producers and consumers over one queue, returns the puzzles per second
+static double queueBenchRun(struct puzzle_queue *lockFree, struct locked_queue *locked, int pairs,
+                            long long count, int batch, const struct puzzle_record *source)
+{
+    struct queue_bench_thread threads[64];
+    long long start = nowNanoseconds(), checksum = 0;
+
+    for (int t = 0; t < 2 * pairs; t++)
+    {
+        threads[t] = (struct queue_bench_thread){0};
+        threads[t].lockFree = lockFree;
+        threads[t].locked = locked;
+        threads[t].source = source;
+        threads[t].count = count / pairs;
+        threads[t].batch = batch;
+        threads[t].producer = t < pairs;
+        pthread_create(&threads[t].thread, NULL, queueBenchThread, &threads[t]);
+    }
+    for (int t = 0; t < 2 * pairs; t++)
+    {
+        pthread_join(threads[t].thread, NULL);
+        checksum += threads[t].checksum;
+    }
+    double seconds = (nowNanoseconds() - start) / 1e9;
+
+    if (checksum != (count / pairs) * pairs * (source->solved[0] + source->unsolved[N * N - 1]))
+        printf("Puzzles were lost or damaged!\n");
+    return (count / pairs) * pairs / seconds;
+}
+
+// Compare the lock free queue with the mutex queue from 2 to 64 threads
+void benchmarkQueue(int count)
+{
+    struct puzzle_queue lockFree;
+    struct locked_queue locked;
+    struct puzzle_record source;
+
+    seedRandom((unsigned int)time(NULL));
+    resetBoard();
+    board.emptyCells = HARD_LVL;
+    fillValues();
+    puzzleRecordFromBoard(&board, &source);
+
+    if (!puzzleQueueInit(&lockFree, 4096) || !lockedQueueInit(&locked, 4096))
+        return;
+
+    printf("%8s %6s %18s %18s\n", "threads", "batch", "lock free (/s)", "mutex (/s)");
+    for (int batch = 1; batch <= 16; batch *= 16)
+    {
+        for (int pairs = 1; pairs <= 32; pairs *= 2)
+        {
+            double fast = queueBenchRun(&lockFree, NULL, pairs, count, batch, &source);
+            double slow = queueBenchRun(NULL, &locked, pairs, count, batch, &source);
+            printf("%8d %6d %18.0f %18.0f\n", 2 * pairs, batch, fast, slow);
+        }
+    }
+
+    puzzleQueueFree(&lockFree);
+    lockedQueueFree(&locked);
+}
+
+
+/* =========== Parallel Generation =========== */
+
+// Every worker is pinned to one core of the CPU list before it touches any memory, so
+// its thread local board, random state and the puzzle buffer it allocates are first
+// touched (and placed) on that core. Shards are cache line aligned, each worker only
+// writes its own shard while running, and the totals are summed after the join.
+// Puzzle k always uses seed + k, so the bank is the same for any number of workers.
+// Options of --generate (name=value):
+//   count    number of puzzles (default 10000)
+//   threads  number of workers (default: number of cores)
+//   cpus     CPU list to pin the workers to, like 0-3,8 (default: no pinning)
+//   level    number of empty cells (default HARD_LVL)
+//   seed     seed of the first puzzle (default: current time)
+//   out      file to write the puzzles to, one "puzzle solution" line each
+
+// Parse a CPU list like 0-3,8, returns the number of CPUs or -1 if the list is invalid
+int parseCpuList(const char *text, int *cpus, int max)
+{
+    int count = 0;
+    while (*text != 0)
+    {
+        char *end;
+        long first = strtol(text, &end, 10), last = first;
+        if (end == text || first < 0)
+            return -1;
+        if (*end == '-')
+        {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+            if (end == text || last < first)
+                return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            if (count == max)
+                return -1;
+            cpus[count++] = (int)cpu;
+        }
+        if (*end == ',')
+            end++;
+        else if (*end != 0)
+            return -1;
+        text = end;
+    }
+    return count;
+}
+
+// thread function of a generation worker
+static void *generationWorker(void *arg)
+{
+    struct generation_shard *shard = arg;
+
+    if (shard->cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(shard->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    // allocate and touch the output here, after pinning, so it is local to the core
+    long long mine = (shard->count - shard->index + shard->shards - 1) / shard->shards;
+    shard->records = malloc((mine > 0 ? mine : 1) * sizeof(struct puzzle_record));
+    if (shard->records == NULL)
+        return NULL;
+    memset(shard->records, 0, (mine > 0 ? mine : 1) * sizeof(struct puzzle_record));
+
+    long long generated = 0, checksum = 0, start = nowNanoseconds();
+    for (long long k = shard->index; k < shard->count; k += shard->shards)
+    {
+        seedRandom(shard->seed + (unsigned int)k);
+        resetBoard();
+        board.emptyCells = shard->difficulty;
+        fillValues();
+        puzzleRecordFromBoard(&board, &shard->records[generated++]);
+        for (int c = 0; c < N * N; c++)
+            checksum += shard->records[generated - 1].unsolved[c];
+    }
+
+    // the shard is written once at the end
+    shard->nanoseconds = nowNanoseconds() - start;
+    shard->generated = generated;
+    shard->checksum = checksum;
+    return NULL;
+}
+
+// Generate puzzles on all shards, the shards must have their options set
+// cpus may be NULL for no pinning, returns the wall time in seconds
+double runGenerationEngine(struct generation_shard *shards, int count, const int *cpus, int cpuCount)
+{
+    long long start = nowNanoseconds();
+    for (int s = 0; s < count; s++)
+    {
+        shards[s].index = s;
+        shards[s].shards = count;
+        shards[s].cpu = cpus != NULL ? cpus[s % cpuCount] : -1;
+        pthread_create(&shards[s].thread, NULL, generationWorker, &shards[s]);
+    }
+    for (int s = 0; s < count; s++)
+        pthread_join(shards[s].thread, NULL);
+    return (nowNanoseconds() - start) / 1e9;
+}
+
+// print the results of every shard and the total
+static void printShards(const struct generation_shard *shards, int count, double seconds)
+{
+    long long generated = 0, checksum = 0;
+    for (int s = 0; s < count; s++)
+    {
+        printf("  shard %2d (cpu %2d): %8lld puzzles, %8.0f per second\n", s, shards[s].cpu,
+               shards[s].generated, shards[s].generated / (shards[s].nanoseconds / 1e9));
+        generated += shards[s].generated;
+        checksum += shards[s].checksum;
+    }
+    printf("  total: %lld puzzles in %.2f s, %.0f per second, checksum %lld\n", generated, seconds,
+           generated / seconds, checksum);
+}
+
+// Generate a bank of puzzles in parallel
+int runGenerate(int argc, char *argv[])
+{
+    int threads = (int)optionNumber(argc, argv, "threads", (double)sysconf(_SC_NPROCESSORS_ONLN));
+    long long count = (long long)optionNumber(argc, argv, "count", 10000);
+    int difficulty = optionLevel(argc, argv, HARD_LVL);
+    unsigned int seed = (unsigned int)optionNumber(argc, argv, "seed", (double)time(NULL));
+    bool withPath = optionNumber(argc, argv, "path", 0) != 0;
+    const char *cpuList = NULL, *out = NULL;
+    int cpus[CPU_SETSIZE], cpuCount = 0;
+
+    for (int a = 2; a < argc; a++)
+    {
+        if (strncmp(argv[a], "cpus=", 5) == 0)
+            cpuList = argv[a] + 5;
+        else if (strncmp(argv[a], "out=", 4) == 0)
+            out = argv[a] + 4;
+    }
+    if (cpuList != NULL && (cpuCount = parseCpuList(cpuList, cpus, CPU_SETSIZE)) <= 0)
+    {
+        printf("Invalid CPU list!\n");
+        return 1;
+    }
+    if (threads < 1 || count < 1 || difficulty < 0 || difficulty > MAX_EMPTY_CELLS)
+    {
+        printf("Invalid generation options!\n");
+        return 1;
+    }
+
+    struct generation_shard *shards = aligned_alloc(CACHE_LINE, threads * sizeof(struct generation_shard));
+    if (shards == NULL)
+        return 1;
+    memset(shards, 0, threads * sizeof(struct generation_shard));
+    for (int s = 0; s < threads; s++)
+    {
+        shards[s].difficulty = difficulty;
+        shards[s].count = count;
+        shards[s].seed = seed;
+    }
+
+    double seconds = runGenerationEngine(shards, threads, cpuList != NULL ? cpus : NULL, cpuCount);
+    printShards(shards, threads, seconds);
+
+    // write the puzzles in seed order, puzzle k is record k / threads of shard k % threads
+    FILE *file = out != NULL ? fopen(out, "w") : NULL;
+    if (out != NULL && file == NULL)
+        printf("Cannot open %s!\n", out);
+    for (long long k = 0; file != NULL && k < count; k++)
+    {
+        const struct puzzle_record *record = &shards[k % threads].records[k / threads];
+        char line[2 * N * N + 2];
+        for (int c = 0; c < N * N; c++)
+        {
+            line[c] = (char)('0' + record->unsolved[c]);
+            line[N * N + 1 + c] = (char)('0' + record->solved[c]);
+        }
+        line[N * N] = ' ';
+        line[2 * N * N + 1] = '\n';
+        if (withPath)
+        {
+            // the solve path as a third field in hex, before the end of the line
+            int grid[N][N], solution[N][N];
+            unsigned char bytes[4 * SOLVE_PATH_STEPS];
+            char hex[8 * SOLVE_PATH_STEPS + 2];
+            struct solve_path path;
+            for (int c = 0; c < N * N; c++)
+            {
+                grid[c / N][c % N] = record->unsolved[c];
+                solution[c / N][c % N] = record->solved[c];
+            }
+            solvePath(grid, solution, &path);
+            int length = pathEncode(&path, bytes);
+            hex[0] = ' ';
+            for (int k = 0; k < length; k++)
+                sprintf(hex + 1 + 2 * k, "%02x", bytes[k]);
+            fwrite(line, 1, sizeof(line) - 1, file);
+            fwrite(hex, 1, 1 + 2 * length, file);
+            fputc('\n', file);
+            continue;
+        }
+        fwrite(line, 1, sizeof(line), file);
+    }
+    if (file != NULL)
+        fclose(file);
+
+    for (int s = 0; s < threads; s++)
+        free(shards[s].records);
+    free(shards);
+    return 0;
+}
+
+// Compare pinned and unpinned generation with one worker per core
+void benchmarkGenerate(int count)
+{
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN), cpus[CPU_SETSIZE], cpuCount = 0;
+    cpu_set_t allowed;
+
+    // pin to the cores this process may use
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &allowed))
+            cpus[cpuCount++] = cpu;
+
+    struct generation_shard *shards = aligned_alloc(CACHE_LINE, threads * sizeof(struct generation_shard));
+    if (shards == NULL)
+        return;
+    unsigned int seed = (unsigned int)time(NULL);
+
+    for (int pinned = 0; pinned <= 1; pinned++)
+    {
+        memset(shards, 0, threads * sizeof(struct generation_shard));
+        for (int s = 0; s < threads; s++)
+        {
+            shards[s].difficulty = HARD_LVL;
+            shards[s].count = count;
+            shards[s].seed = seed;
+        }
+        double seconds = runGenerationEngine(shards, threads, pinned ? cpus : NULL, cpuCount);
+        printf("%s:\n", pinned ? "Pinned" : "Unpinned");
+        printShards(shards, threads, seconds);
+        for (int s = 0; s < threads; s++)
+            free(shards[s].records);
+    }
+    free(shards);
+}
+
+
+/* =========== Lazy Generation =========== */
+
+// The lazy generator does the same work as fillValues() (same random numbers, same
+// search order, same removals, so the first puzzle matches newGame() with the same seed)
+// but as a state machine. A step fills one diagonal box, places or takes back one digit
+// of the search, or removes one digit. Callers pull puzzles with generatorStep() and a
+// step budget, so a single threaded event loop can generate between key presses.
+
+// draw a random number from the generator's own random state
+static int generatorRandom(struct puzzle_generator *g, int num)
+{
+    unsigned long long threadState = randomState; // borrow the thread's generator
+    randomState = g->random;
+    int r = randomGenerator(num);
+    g->random = randomState;
+    randomState = threadState;
+    return r;
+}
+
+// put a digit in a diagonal box of the generator's board
+static void generatorSet(struct puzzle_generator *g, int cell, int num)
+{
+    int i = cell / N, j = cell % N;
+    g->boxes[(i / MINI_BOX_SIZE) * MINI_BOX_SIZE + j / MINI_BOX_SIZE] |= 1 << num;
+    g->board.unsolved[i][j] = num;
+}
+
+// prepare the generator for its next puzzle
+static void generatorRestart(struct puzzle_generator *g)
+{
+    memset(&g->board, 0, sizeof(g->board));
+    memset(g->boxes, 0, sizeof(g->boxes));
+    g->board.emptyCells = g->difficulty;
+    g->phase = GEN_DIAGONAL;
+    g->box = 0;
+    g->removed = 0;
+}
+
+// Start a lazy generator
+void generatorInit(struct puzzle_generator *g, int difficulty, unsigned int seed)
+{
+    g->random = ((unsigned long long)seed + 1) * 0x9E3779B97F4A7C15ULL; // same as seedRandom()
+    g->difficulty = difficulty;
+    g->steps = 0;
+    generatorRestart(g);
+}
+
+// Advance a lazy generator by at most budget steps
+// returns true when a puzzle is ready in g->board, the next call starts the next puzzle
+bool generatorStep(struct puzzle_generator *g, int budget)
+{
+    if (g->phase == GEN_READY)
+        generatorRestart(g);
+
+    while (budget-- > 0)
+    {
+        g->steps++;
+        switch (g->phase)
+        {
+        case GEN_DIAGONAL:
+        {
+            // fill one diagonal box like fillBox()
+            int start = g->box * MINI_BOX_SIZE;
+            for (int i = 0; i < MINI_BOX_SIZE; i++)
+            {
+                for (int j = 0; j < MINI_BOX_SIZE; j++)
+                {
+                    int num;
+                    do
+                    {
+                        num = generatorRandom(g, N);
+                    } while (g->boxes[g->box * (MINI_BOX_SIZE + 1)] & (1 << num));
+                    generatorSet(g, (start + i) * N + start + j, num);
+                }
+            }
+            if (++g->box == MINI_BOX_SIZE)
+            {
+                g->phase = GEN_SEARCH;
+                fillSearchInit(&g->search, &g->board, 0); // the cells outside the diagonal boxes
+            }
+            break;
+        }
+        case GEN_SEARCH:
+            // place or take back one digit, like one loop turn of fillRemaining()
+            if (fillSearchRun(&g->search, 1) == FILL_DONE)
+            {
+                memcpy(g->board.solved, g->board.unsolved, sizeof(g->board.solved));
+                g->phase = GEN_EMPTY;
+            }
+            break;
+        case GEN_EMPTY:
+        {
+            // one removal attempt like a loop turn of addEmptyCells(), with its column quirk
+            if (g->removed < g->difficulty)
+            {
+                int cellId = generatorRandom(g, N * N) - 1;
+                int i = cellId / N, j = cellId % N;
+                if (j != 0)
+                    j = j - 1;
+                if (g->board.unsolved[i][j] != 0)
+                {
+                    g->removed++;
+                    g->board.unsolved[i][j] = 0;
+                }
+            }
+            if (g->removed == g->difficulty)
+            {
+                g->phase = GEN_READY;
+                return true;
+            }
+            break;
+        }
+        }
+    }
+    return false;
+}
+
+// Run a lazy generator to the next puzzle and copy it to out
+void generatorNext(struct puzzle_generator *g, struct sudoku_board *out)
+{
+    while (!generatorStep(g, 1 << 20))
+        ;
+    *out = g->board;
+}
+
+// Pull puzzles in slices of 64 steps and measure the longest slice
+void benchmarkLazy(int count)
+{
+    static struct puzzle_generator g;
+    struct game_state game = {0};
+    unsigned int seed = (unsigned int)time(NULL);
+    long long longest = 0, slices = 0;
+
+    // the first puzzle must match the one newGame() makes from the same seed
+    generatorInit(&g, HARD_LVL, seed);
+    generatorNext(&g, &g.board);
+    newGame(&board, &game, HARD_LVL, seed);
+    if (memcmp(g.board.unsolved, board.unsolved, sizeof(board.unsolved)) != 0 ||
+        memcmp(g.board.solved, board.solved, sizeof(board.solved)) != 0)
+        printf("Lazy puzzle differs from fillValues()!\n");
+
+    generatorInit(&g, HARD_LVL, seed);
+    long long start = nowNanoseconds();
+    for (int made = 0; made < count; slices++)
+    {
+        long long sliceStart = nowNanoseconds();
+        made += generatorStep(&g, 64);
+        long long slice = nowNanoseconds() - sliceStart;
+        if (slice > longest)
+            longest = slice;
+    }
+    long long end = nowNanoseconds();
+
+    printf("%d puzzles in %lld slices of 64 steps, %.0f puzzles per second\n", count, slices,
+           count / ((end - start) / 1e9));
+    printf("Steps: %.0f per puzzle, slice time: %.2f us mean, %.2f us longest\n", (double)g.steps / count,
+           (end - start) / 1000.0 / slices, longest / 1000.0);
+}
+
+
+/* =========== Explicit Stack Search =========== */
+
+// fillRemaining() used to recurse once per cell. The search now keeps one frame per
+// cell in a fixed array: the digit placed in it, or the last digit tried in the current
+// frame. A step either places the next safe digit and goes one frame deeper, or takes
+// back the digit of the previous frame. The order of digits and cells is the same as in
+// the recursive search, so both fill a board the same way. Because the whole position
+// is the frame array, a search can stop after any step and be saved as a checkpoint.
+
+// Prepare a search for the empty cells from start on
+void fillSearchInit(struct fill_search *search, struct sudoku_board *b, int start)
+{
+    search->board = b;
+    search->cellCount = 0;
+    search->depth = 0;
+    search->tried[0] = 0;
+    search->nodes = 0;
+    search->backtracks = 0;
+    memset(search->rows, 0, sizeof(search->rows));
+    memset(search->cols, 0, sizeof(search->cols));
+    memset(search->boxes, 0, sizeof(search->boxes));
+
+    for (int cell = 0; cell < N * N; cell++)
+    {
+        int i = cell / N, j = cell % N, num = b->unsolved[i][j];
+        if (num != 0)
+        {
+            search->rows[i] |= 1 << num;
+            search->cols[j] |= 1 << num;
+            search->boxes[(i / MINI_BOX_SIZE) * MINI_BOX_SIZE + j / MINI_BOX_SIZE] |= 1 << num;
+        }
+        else if (cell >= start)
+            search->cells[search->cellCount++] = cell;
+    }
+}
+
+// Run a search for at most budget steps, -1 for no limit
+// returns FILL_DONE, FILL_FAILED or FILL_PAUSED
+int fillSearchRun(struct fill_search *search, long long budget)
+{
+    int *rows = search->rows, *cols = search->cols, *boxes = search->boxes;
+    int depth = search->depth;
+
+    while (depth < search->cellCount && budget-- != 0)
+    {
+        int cell = search->cells[depth], i = cell / N, j = cell % N;
+        int box = (i / MINI_BOX_SIZE) * MINI_BOX_SIZE + j / MINI_BOX_SIZE;
+        int used = rows[i] | cols[j] | boxes[box];
+        int num = search->tried[depth] + 1;
+
+        // the next digit that is absent in the row, the column and the box
+        while (num <= N && (used & (1 << num)))
+            num++;
+
+        if (num <= N)
+        {
+            rows[i] |= 1 << num;
+            cols[j] |= 1 << num;
+            boxes[box] |= 1 << num;
+            search->board->unsolved[i][j] = num;
+            search->tried[depth++] = num;
+            search->tried[depth] = 0;
+            search->nodes++;
+        }
+        else
+        {
+            if (depth == 0)
+            {
+                search->depth = 0;
+                return FILL_FAILED; // no digit fits the first cell
+            }
+
+            // take back the digit of the previous frame, it tries its next digit
+            cell = search->cells[--depth];
+            i = cell / N;
+            j = cell % N;
+            num = search->tried[depth];
+            rows[i] &= ~(1 << num);
+            cols[j] &= ~(1 << num);
+            boxes[(i / MINI_BOX_SIZE) * MINI_BOX_SIZE + j / MINI_BOX_SIZE] &= ~(1 << num);
+            search->board->unsolved[i][j] = 0;
+            search->backtracks++;
+            TRACE3(backtrack, depth, cell, num); // probe: the digit num is taken back from cell
+        }
+    }
+
+    search->depth = depth;
+    return depth == search->cellCount ? FILL_DONE : FILL_PAUSED;
+}
+
+// Save the position of a search, out needs N * N + 2 bytes
+// returns the length of the checkpoint: the depth and the digits of frames 0 to depth
+int fillSearchCheckpoint(const struct fill_search *search, unsigned char *out)
+{
+    out[0] = (unsigned char)search->depth;
+    for (int k = 0; k <= search->depth && k < N * N; k++)
+        out[1 + k] = (unsigned char)search->tried[k];
+    return 2 + (search->depth < N * N ? search->depth : N * N - 1);
+}
+
+// Continue a search from a checkpoint
+// search must be freshly prepared by fillSearchInit() on the board the checkpoint came from
+bool fillSearchRestore(struct fill_search *search, const unsigned char *in, int length)
+{
+    int depth = in[0];
+    if (depth > search->cellCount || length < 2 + (depth < N * N ? depth : N * N - 1))
+        return false;
+
+    for (int k = 0; k < depth; k++)
+    {
+        int cell = search->cells[k], i = cell / N, j = cell % N, num = in[1 + k];
+        int box = (i / MINI_BOX_SIZE) * MINI_BOX_SIZE + j / MINI_BOX_SIZE;
+        if (num < 1 || num > N || ((search->rows[i] | search->cols[j] | search->boxes[box]) & (1 << num)))
+            return false; // does not fit this board
+        search->rows[i] |= 1 << num;
+        search->cols[j] |= 1 << num;
+        search->boxes[box] |= 1 << num;
+        search->board->unsolved[i][j] = num;
+        search->tried[k] = num;
+    }
+    search->depth = depth;
+    search->tried[depth] = depth < N * N ? in[1 + depth] : 0;
+    return true;
+}
+
+// Compare the explicit stack search with the recursive one on the same boards
+void benchmarkFill(int count)
+{
+    struct sudoku_board *starts = malloc(count * sizeof(struct sudoku_board));
+    struct fill_search search;
+    long long nodes = 0, backtracks = 0, recursive = 0, iterative = 0;
+    unsigned char checkpoint[N * N + 2];
+    bool same = true;
+    struct perf_counters counters[2];
+
+    if (starts == NULL)
+        return;
+    perfOpen(&counters[0]);
+    perfOpen(&counters[1]);
+
+    // boards with the diagonal boxes filled, like fillValues() makes them
+    seedRandom((unsigned int)time(NULL));
+    for (int k = 0; k < count; k++)
+    {
+        resetBoard();
+        fillDiagonal();
+        starts[k] = board;
+    }
+
+    for (int k = 0; k < count; k++)
+    {
+        board = starts[k];
+        perfStart(&counters[0]);
+        long long start = nowNanoseconds();
+        fillRemainingRecursive(0, MINI_BOX_SIZE);
+        recursive += nowNanoseconds() - start;
+        perfStop(&counters[0]);
+        struct sudoku_board filled = board;
+
+        board = starts[k];
+        perfStart(&counters[1]);
+        start = nowNanoseconds();
+        fillSearchInit(&search, &board, 0);
+        fillSearchRun(&search, -1);
+        iterative += nowNanoseconds() - start;
+        perfStop(&counters[1]);
+        nodes += search.nodes;
+        backtracks += search.backtracks;
+        same &= memcmp(filled.unsolved, board.unsolved, sizeof(board.unsolved)) == 0;
+    }
+
+    // pause every search half way, save it, and finish it from the checkpoint
+    for (int k = 0; k < count && same; k++)
+    {
+        board = starts[k];
+        fillSearchInit(&search, &board, 0);
+        fillSearchRun(&search, 20);
+        int length = fillSearchCheckpoint(&search, checkpoint);
+        board = starts[k];
+        fillSearchInit(&search, &board, 0);
+        same &= fillSearchRestore(&search, checkpoint, length) && fillSearchRun(&search, -1) == FILL_DONE;
+        struct sudoku_board resumed = board;
+        board = starts[k];
+        fillRemainingRecursive(0, MINI_BOX_SIZE);
+        same &= memcmp(resumed.unsolved, board.unsolved, sizeof(board.unsolved)) == 0;
+    }
+
+    if (!same)
+        printf("Explicit stack search differs from the recursive search!\n");
+    printf("%d boards, %.0f nodes and %.0f backtracks per board\n", count, (double)nodes / count,
+           (double)backtracks / count);
+    printf("Recursive: %.2f us per board, %.1f million nodes per second\n", recursive / 1000.0 / count,
+           (nodes + backtracks) / (recursive / 1000.0));
+    printf("Explicit stack: %.2f us per board, %.1f million nodes per second\n", iterative / 1000.0 / count,
+           (nodes + backtracks) / (iterative / 1000.0));
+    perfReport(&counters[0], "Recursive", count, "board");
+    perfReport(&counters[1], "Explicit stack", count, "board");
+    perfClose(&counters[0]);
+    perfClose(&counters[1]);
+    free(starts);
+}
+
+
+/* =========== Live Mode =========== */
+
+// With --live the game runs in an event loop instead of blocking in scanf(). epoll
+// waits on stdin (in raw mode, one key at a time) and on a timerfd that ticks four
+// times a second for the clock. While the player thinks, the loop advances the lazy
+// generator in short slices to have the next puzzle ready. Every event updates the game
+// and renders a frame into a buffer, and the frame is only written when it changed.
+// Keys: arrows or h/j/k/l move, 1 to 9 enter a value, u undoes, n starts the next
+// puzzle, q or Ctrl-C quits. With stats=DIR every solved or abandoned game is added to the
+// stats of player=NAME in that directory.
+
+#define LIVE_FRAME 4096     // size of a rendered frame
+#define LIVE_SLICE 256      // generator steps between two looks at the events
+
+// Live mode state
+struct live_game {
+    struct sudoku_board board;
+    struct game_state game;
+    struct puzzle_generator generator;  // makes the next puzzle in the background
+    bool nextReady;         // generator holds a finished puzzle
+    int row, col;           // cursor
+    long long started;      // start time of the game in ns
+    long long solvedAfter;  // time to solve in ns, 0 while playing
+    long long latency;      // time from the last key to its frame in ns
+    const char *message;    // status line
+    char frame[LIVE_FRAME]; // last written frame
+    int frameLength;
+    bool quit;
+    bool keepStats;         // finished games go to the stats store
+    bool recorded;          // the game is in the stats store already
+    unsigned long long player;  // id of the player in the stats store
+    struct stats_store stats;
+};
+
+struct termios liveSavedTerminal;   // terminal settings to restore on exit
+
+// restore the terminal on exit
+static void liveRestoreTerminal()
+{
+    tcsetattr(STDIN_FILENO, TCSANOW, &liveSavedTerminal);
+    if (write(STDOUT_FILENO, "\033[?25h\n", 7) < 0) // show the cursor again
+        return;
+}
+
+// restore the terminal when a signal ends the live mode, then die of the signal as before
+static void liveSignal(int signal)
+{
+    liveRestoreTerminal(); // tcsetattr and write are safe in a signal handler
+    sigaction(signal, &(struct sigaction){.sa_handler = SIG_DFL}, NULL);
+    raise(signal);
+}
+
+// add the game to the stats of the player, a game left without a value entered is not counted
+static void liveRecordGame(struct live_game *live, bool solved)
+{
+    if (!live->keepStats || live->recorded || (!solved && live->game.attempts == 0))
+        return;
+    live->recorded = true; // a game solved again after an undo is counted once
+    long long played = solved ? live->solvedAfter : nowNanoseconds() - live->started;
+    struct stats_record record = {.player = live->player, .when = (unsigned int)time(NULL),
+                                  .seconds = (unsigned int)(played / 1000000000LL),
+                                  .attempts = (unsigned int)live->game.attempts,
+                                  .level = (unsigned char)statsLevel(live->game.difficulty), .solved = solved};
+    if (!statsRecord(&live->stats, &record))
+        live->message = "Could not save the stats of this game";
+}
+
+// start the next game, from the background generator if it is ready
+static void liveNewGame(struct live_game *live)
+{
+    if (live->solvedAfter == 0)
+        liveRecordGame(live, false); // given up
+
+    if (live->nextReady)
+    {
+        live->board = live->generator.board;
+        gameStart(&live->board, &live->game, live->game.difficulty, 0); // made by the generator, not from a single seed
+        live->nextReady = false;
+        live->message = "New game";
+    }
+    else
+    {
+        newGame(&live->board, &live->game, live->game.difficulty, (unsigned int)time(NULL));
+        live->message = "New game (generated while you waited)";
+    }
+    live->started = nowNanoseconds();
+    live->solvedAfter = 0;
+    live->recorded = false;
+}
+
+// render the game into a buffer in the style of printSudoku(), returns its length
+static int liveRender(struct live_game *live, char *out)
+{
+    char *p = out;
+    long long elapsed = (live->solvedAfter != 0 ? live->solvedAfter : nowNanoseconds() - live->started) / 1000000000LL;
+
+    p += sprintf(p, "\033[H\033[2J"); // cursor home and clear, without spawning clear
+    p += sprintf(p, "Sudoku  %s  time %02lld:%02lld  attempts %d  next puzzle: %s\r\n\r\n",
+                 difficultyName(live->game.difficulty), elapsed / 60, elapsed % 60, live->game.attempts,
+                 live->nextReady ? "ready" : "generating");
+    p += sprintf(p, "  ┌───────┬───────┬───────┐\r\n");
+    for (int i = 0; i < N; i++)
+    {
+        if (i != 0 && i % 3 == 0)
+            p += sprintf(p, "  ├───────┼───────┼───────┤\r\n");
+        p += sprintf(p, "  │");
+        for (int j = 0; j < N; j++)
+        {
+            int num = live->board.unsolved[i][j];
+            char cell = num != 0 ? (char)('0' + num) : '.';
+            *p++ = ' ';
+            if (i == live->row && j == live->col)
+                p += sprintf(p, "\033[7m%c\033[0m", cell); // cursor in reverse video
+            else
+                *p++ = cell;
+            if ((j + 1) % 3 == 0)
+                p += sprintf(p, " │");
+        }
+        p += sprintf(p, "\r\n");
+    }
+    p += sprintf(p, "  └───────┴───────┴───────┘\r\n\r\n");
+    p += sprintf(p, "%s\r\n", live->message);
+    p += sprintf(p, "arrows/hjkl move, 1-9 enter, u undo, n new game, q quit  (input latency %.0f us)\r\n",
+                 live->latency / 1000.0);
+    return (int)(p - out);
+}
+
+// render a frame and write it only if it differs from the last one
+static void liveRedraw(struct live_game *live)
+{
+    char frame[LIVE_FRAME];
+    int length = liveRender(live, frame);
+    if (length == live->frameLength && memcmp(frame, live->frame, length) == 0)
+        return; // nothing changed
+    memcpy(live->frame, frame, length);
+    live->frameLength = length;
+    if (write(STDOUT_FILENO, frame, length) != length)
+        live->quit = true;
+}
+
+// dispatch one event to the game
+static void liveDispatch(struct live_game *live, int event, int key)
+{
+    int row, col;
+    switch (event)
+    {
+    case EVENT_TICK:
+        break; // the clock is redrawn below
+    case EVENT_GENERATED:
+        live->nextReady = true;
+        break;
+    case EVENT_KEY:
+        if (key == 'q')
+        {
+            if (live->solvedAfter == 0)
+                liveRecordGame(live, false);
+            live->quit = true;
+        }
+        else if (key == KEY_UP || key == 'k')
+            live->row = (live->row + N - 1) % N;
+        else if (key == KEY_DOWN || key == 'j')
+            live->row = (live->row + 1) % N;
+        else if (key == KEY_LEFT || key == 'h')
+            live->col = (live->col + N - 1) % N;
+        else if (key == KEY_RIGHT || key == 'l')
+            live->col = (live->col + 1) % N;
+        else if (key == 'n')
+            liveNewGame(live);
+        else if (key == 'u')
+        {
+            live->message = "Nothing to undo";
+            if (undoMove(&live->board, &live->game, &row, &col))
+            {
+                live->message = "Undone";
+                live->solvedAfter = 0; // the board is open again, the clock goes on from the start
+            }
+        }
+        else if (key >= '1' && key <= '9' && live->solvedAfter == 0)
+        {
+            switch (applyMove(&live->board, &live->game, live->row, live->col, key - '0'))
+            {
+            case MOVE_ACCEPTED:
+                live->message = "Correct!";
+                if (live->board.emptyCells == 0)
+                {
+                    live->solvedAfter = nowNanoseconds() - live->started;
+                    live->message = "Congratulations! You solved the board! Press n for a new game";
+                    liveRecordGame(live, true);
+                }
+                break;
+            case MOVE_WRONG:
+                live->message = "Invalid value!";
+                break;
+            case MOVE_DEAD_END:
+                live->message = "No solution from here, press u to undo";
+                break;
+            default:
+                live->message = "This cell is already filled!";
+            }
+        }
+        break;
+    }
+}
+
+// read the pending keys from stdin and dispatch them, arrows come as escape sequences
+static void liveReadKeys(struct live_game *live)
+{
+    unsigned char keys[64];
+    ssize_t length = read(STDIN_FILENO, keys, sizeof(keys));
+    if (length <= 0)
+    {
+        live->quit = true; // stdin closed
+        return;
+    }
+    for (ssize_t k = 0; k < length; k++)
+    {
+        int key = keys[k];
+        if (key == 27 && k + 2 < length && keys[k + 1] == '[' && keys[k + 2] >= 'A' && keys[k + 2] <= 'D')
+        {
+            static const int arrows[] = {KEY_UP, KEY_DOWN, KEY_RIGHT, KEY_LEFT};
+            key = arrows[keys[k + 2] - 'A'];
+            k += 2;
+        }
+        else if (key == 3)
+            key = 'q'; // Ctrl-C, the raw terminal sends it as a key so the game is recorded
+        liveDispatch(live, EVENT_KEY, key);
+    }
+}
+
+// Play with a clock in an event loop
+int runLive(int argc, char *argv[])
+{
+    static struct live_game live;
+    const char *level = "medium", *statsDir = NULL, *player = NULL;
+    for (int a = 2; a < argc; a++)
+    {
+        if (strncmp(argv[a], "level=", 6) == 0)
+            level = argv[a] + 6;
+        else if (strncmp(argv[a], "stats=", 6) == 0)
+            statsDir = argv[a] + 6;
+        else if (strncmp(argv[a], "player=", 7) == 0)
+            player = argv[a] + 7;
+    }
+    if (statsDir != NULL)
+    {
+        if (!statsOpen(&live.stats, statsDir))
+        {
+            printf("Could not open the stats in %s%s\n", statsDir,
+                   errno == EWOULDBLOCK ? ", another process is using them" : "");
+            return 1;
+        }
+        live.keepStats = true;
+        live.player = statsPlayerId(player != NULL ? player : "player");
+    }
+
+    live.game.difficulty = difficultyFromName(level, (int)strlen(level));
+    if (live.game.difficulty < 0)
+        live.game.difficulty = MEDIUM_LVL;
+    if (!gameFreeEntry(&live.board, &live.game, optionNumber(argc, argv, "free", 0) != 0))
+        return 1;
+
+    // raw terminal: keys arrive one at a time and are not echoed, Ctrl-C is a key too
+    if (tcgetattr(STDIN_FILENO, &liveSavedTerminal) != 0)
+    {
+        printf("The live mode needs a terminal!\n");
+        return 1;
+    }
+    struct termios raw = liveSavedTerminal;
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    atexit(liveRestoreTerminal);
+    static const int signals[] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT};
+    for (int s = 0; s < (int)(sizeof(signals) / sizeof(signals[0])); s++)
+        sigaction(signals[s], &(struct sigaction){.sa_handler = liveSignal}, NULL);
+    if (write(STDOUT_FILENO, "\033[?25l", 6) < 0) // hide the terminal cursor
+        return 1;
+
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    struct itimerspec tick = {{0, 250000000}, {0, 250000000}};
+    timerfd_settime(timer, 0, &tick, NULL);
+
+    int loop = epoll_create1(0);
+    struct epoll_event watch = {.events = EPOLLIN};
+    watch.data.fd = STDIN_FILENO;
+    epoll_ctl(loop, EPOLL_CTL_ADD, STDIN_FILENO, &watch);
+    watch.data.fd = timer;
+    epoll_ctl(loop, EPOLL_CTL_ADD, timer, &watch);
+
+    newGame(&live.board, &live.game, live.game.difficulty, (unsigned int)time(NULL));
+    live.started = nowNanoseconds();
+    live.message = "Welcome to Sudoku!";
+    generatorInit(&live.generator, live.game.difficulty, (unsigned int)time(NULL) + 1);
+    liveRedraw(&live);
+
+    while (!live.quit)
+    {
+        // do not sleep while the generator has work, just look for events
+        struct epoll_event events[4];
+        int count = epoll_wait(loop, events, 4, live.nextReady ? -1 : 0);
+
+        for (int e = 0; e < count; e++)
+        {
+            long long start = nowNanoseconds();
+            if (events[e].data.fd == STDIN_FILENO)
+            {
+                liveReadKeys(&live);
+                liveRedraw(&live);
+                live.latency = nowNanoseconds() - start;
+            }
+            else
+            {
+                unsigned long long expirations;
+                if (read(timer, &expirations, sizeof(expirations)) > 0)
+                    liveDispatch(&live, EVENT_TICK, 0);
+                liveRedraw(&live);
+            }
+        }
+
+        // no event is waiting: advance the next puzzle by one short slice
+        if (count == 0 && !live.nextReady && generatorStep(&live.generator, LIVE_SLICE))
+        {
+            liveDispatch(&live, EVENT_GENERATED, 0);
+            liveRedraw(&live);
+        }
+    }
+
+    close(timer);
+    close(loop);
+    if (live.keepStats)
+        statsClose(&live.stats);
+    return 0;
+}
+
+
+/* =========== Grading =========== */
+
+// Count the solutions of a puzzle up to limit, with the bitboard engine
+int countSolutions(const int grid[N][N], int limit)
+{
+    return bitboardSolve(grid, NULL, limit);
+}
+
+// Look up the count of a board in the transposition table, -1 if it is not there
+static inline int transpositionProbe(unsigned long long hash)
+{
+    unsigned long long entry = atomic_load_explicit(&transposition.entries[hash & transposition.mask],
+                                                    memory_order_relaxed);
+    searchStats.probes++;
+    if (entry == 0 || ((entry ^ hash) & ~3ull) != 0)
+        return -1;
+    searchStats.hits++;
+    metricsCount(METRIC_CACHE_HITS, 1);
+    return (int)(entry & 3) - 1;
+}
+
+// Keep the count of a board (0, 1 or 2 for two or more) in the transposition table
+static inline void transpositionStore(unsigned long long hash, int solutions)
+{
+    unsigned long long entry = (hash & ~3ull) | (unsigned long long)((solutions < 2 ? solutions : 2) + 1);
+    atomic_store_explicit(&transposition.entries[hash & transposition.mask], entry, memory_order_relaxed);
+}
+
+// Count the solutions of a puzzle up to limit
+// a backtracking search with the checkIfSafe() rules as digit masks, it always branches
+// on the empty cell with the fewest candidates, kept to compare the bitboard engine with
+// with a limit of 1 or 2 it caches the count of every finished subtree in the transposition
+// table, the key is the Zobrist hash of the digits on the board kept up to date on every move
+int countSolutionsMasks(const int grid[N][N], int limit)
+{
+    int rows[N] = {0}, cols[N] = {0}, boxes[N] = {0};
+    int cells[N * N], tried[N * N + 1], count = 0, depth = 0, solutions = 0;
+    int value[N * N], frameSolutions[N * N + 1];
+    unsigned long long hash = 0, frameHash[N * N + 1];
+    bool cache = transposition.entries != NULL && limit <= 2;
+
+    for (int cell = 0; cell < N * N; cell++)
+    {
+        int i = cell / N, j = cell % N, num = grid[i][j], box = (i / MINI_BOX_SIZE) * MINI_BOX_SIZE + j / MINI_BOX_SIZE;
+        value[cell] = num;
+        if (num == 0)
+        {
+            cells[count++] = cell;
+            continue;
+        }
+        if ((rows[i] | cols[j] | boxes[box]) & (1 << num))
+            return 0; // the clues break the rules
+        rows[i] |= 1 << num;
+        cols[j] |= 1 << num;
+        boxes[box] |= 1 << num;
+        hash ^= zobristKeys[cell][num];
+    }
+
+    tried[0] = 0;
+    while (depth >= 0)
+    {
+        if (depth == count)
+        {
+            if (++solutions >= limit)
+                return solutions;
+            depth--; // look for the next solution
+        }
+        else if (tried[depth] == 0)
+        {
+            // new frame: move the empty cell with the fewest candidates to this depth
+            int best = depth, fewest = N + 1;
+            for (int k = depth; k < count && fewest > 1; k++)
+            {
+                int i = cells[k] / N, j = cells[k] % N;
+                int open = N - __builtin_popcount(rows[i] | cols[j] | boxes[(i / MINI_BOX_SIZE) * MINI_BOX_SIZE + j / MINI_BOX_SIZE]);
+                if (open < fewest)
+                {
+                    fewest = open;
+                    best = k;
+                }
+            }
+            int swap = cells[depth];
+            cells[depth] = cells[best];
+            cells[best] = swap;
+
+            // the board may have been counted before through other moves, a dead board
+            // is cheaper to search than to look up
+            frameHash[depth] = 0;
+            if (cache && fewest > 0)
+            {
+                int cached = transpositionProbe(hash);
+                if (cached >= 0)
+                {
+                    solutions += cached;
+                    if (solutions >= limit)
+                        return limit;
+                    depth--;
+                    continue;
+                }
+                frameHash[depth] = hash;
+                frameSolutions[depth] = solutions;
+            }
+        }
+
+        if (depth < 0)
+            break;
+        int cell = cells[depth], i = cell / N, j = cell % N, box = (i / MINI_BOX_SIZE) * MINI_BOX_SIZE + j / MINI_BOX_SIZE;
+        if (value[cell] != 0)
+        {
+            // take back the digit placed here before trying the next one
+            rows[i] &= ~(1 << value[cell]);
+            cols[j] &= ~(1 << value[cell]);
+            boxes[box] &= ~(1 << value[cell]);
+            hash ^= zobristKeys[cell][value[cell]];
+            value[cell] = 0;
+        }
+
+        int used = rows[i] | cols[j] | boxes[box], num = tried[depth] + 1;
+        while (num <= N && (used & (1 << num)))
+            num++;
+        if (num <= N)
+        {
+            rows[i] |= 1 << num;
+            cols[j] |= 1 << num;
+            boxes[box] |= 1 << num;
+            hash ^= zobristKeys[cell][num];
+            value[cell] = num;
+            tried[depth++] = num;
+            tried[depth] = 0;
+            searchStats.nodes++;
+        }
+        else
+        {
+            // every digit was tried, the count of this board is final
+            if (frameHash[depth] != 0)
+                transpositionStore(frameHash[depth], solutions - frameSolutions[depth]);
+            tried[depth] = 0;
+            depth--;
+        }
+    }
+    return solutions;
+}
+
+// Grade a puzzle into a difficulty band by solving it like a player would
+// every step places the easiest single there is: a naked single, else a hidden single
+int gradePuzzle(const int grid[N][N], struct grade_report *report)
+{
+    unsigned short cand[N * N];
+    int value[N * N], left = 0;
+
+    memset(report, 0, sizeof(*report));
+    report->solutions = countSolutions(grid, 2);
+    if (report->solutions != 1)
+        return report->band = BAND_INVALID;
+
+    boardCandidates(grid, cand);
+    for (int cell = 0; cell < N * N; cell++)
+    {
+        value[cell] = grid[cell / N][cell % N];
+        left += value[cell] == 0;
+    }
+
+    while (left > 0)
+    {
+        int cell = -1, num = 0;
+        for (int c = 0; c < N * N && cell < 0; c++)
+        {
+            if (value[c] == 0 && (cand[c] & (cand[c] - 1)) == 0)
+            {
+                cell = c;
+                num = __builtin_ctz(cand[c]);
+            }
+        }
+        if (cell >= 0)
+            report->nakedSingles++;
+        else
+        {
+            for (int u = 0; u < UNITS && cell < 0; u++)
+            {
+                int once = 0, twice = 0;
+                for (int k = 0; k < N; k++)
+                {
+                    int c = unitCells[u][k];
+                    if (value[c] == 0)
+                    {
+                        twice |= once & cand[c];
+                        once |= cand[c];
+                    }
+                }
+                int hidden = once & ~twice;
+                for (int k = 0; k < N && hidden != 0 && cell < 0; k++)
+                {
+                    int c = unitCells[u][k];
+                    if (value[c] == 0 && (cand[c] & hidden))
+                    {
+                        cell = c;
+                        num = __builtin_ctz(cand[c] & hidden);
+                    }
+                }
+            }
+            if (cell < 0)
+            {
+                report->stuckCells = left;
+                return report->band = BAND_HARD;
+            }
+            report->hiddenSingles++;
+        }
+
+        value[cell] = num;
+        cand[cell] = 0;
+        left--;
+        for (int p = 0; p < PEERS; p++)
+            cand[cellPeers[cell][p]] &= ~(1 << num);
+    }
+    return report->band = report->hiddenSingles > 0 ? BAND_MEDIUM : BAND_EASY;
+}
+
+// Name of a difficulty band
+const char *bandName(int band)
+{
+    static const char *names[BAND_COUNT] = {"invalid", "easy", "medium", "hard"};
+    return band >= 0 && band < BAND_COUNT ? names[band] : "unknown";
+}
+
+
+/* =========== Speculative Band Generation =========== */
+
+// Most generated puzzles land outside the wanted band, so a request runs several
+// attempts on idle cores. Each attempt generates candidates with the lazy generator
+// (with a number of empty cells typical for the band) and grades them. The first match
+// wins with a compare and swap on the race, and the other attempts see it between two
+// generator slices and stop. Work is measured as thread CPU time; the wasted work is
+// everything except the winning candidate.
+
+#define BAND_SLICE 512      // generator steps between two looks at the race
+
+// CPU time of the calling thread in ns
+static long long threadNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// thread function of a speculative attempt
+static void *bandAttempt(void *arg)
+{
+    // empty cells of the candidates, from the first to the second number
+    static const int emptyRange[BAND_COUNT][2] = {{0, 0}, {EASY_LVL, 30}, {30, 45}, {40, 50}};
+    struct band_attempt *attempt = arg;
+    struct band_race *race = attempt->race;
+    struct puzzle_generator *g = malloc(sizeof(struct puzzle_generator));
+    struct grade_report report;
+    long long start = threadNanoseconds();
+    unsigned int seed = race->seed + (unsigned int)attempt->index * 1000003u;
+
+    seedRandom(seed);
+    while (g != NULL && atomic_load_explicit(&race->winner, memory_order_relaxed) < 0)
+    {
+        long long candidateStart = threadNanoseconds();
+        int low = emptyRange[race->band][0], high = emptyRange[race->band][1];
+        generatorInit(g, low + randomGenerator(high - low + 1) - 1, seed++);
+        while (!generatorStep(g, BAND_SLICE))
+        {
+            if (atomic_load_explicit(&race->winner, memory_order_relaxed) >= 0)
+                break; // another attempt won, stop cooperatively
+        }
+        if (g->phase != GEN_READY)
+            break;
+
+        attempt->candidates++;
+        int expected = -1;
+        if (gradePuzzle(g->board.unsolved, &report) == race->band &&
+            atomic_compare_exchange_strong(&race->winner, &expected, attempt->index))
+        {
+            race->result = g->board;
+            attempt->winningWork = threadNanoseconds() - candidateStart;
+        }
+    }
+
+    attempt->work = threadNanoseconds() - start;
+    free(g);
+    return NULL;
+}
+
+// Race attempts for a puzzle in a band
+// returns the wasted work ratio of the request, or -1 if the band is not valid
+double generateInBand(int band, int attempts, struct sudoku_board *out, int *candidates)
+{
+    struct band_race race;
+    struct band_attempt *threads = calloc(attempts, sizeof(struct band_attempt));
+    if (band <= BAND_INVALID || band >= BAND_COUNT || threads == NULL)
+    {
+        free(threads);
+        return -1;
+    }
+
+    race.band = band;
+    race.seed = (unsigned int)nowNanoseconds();
+    atomic_init(&race.winner, -1);
+    for (int a = 0; a < attempts; a++)
+    {
+        threads[a].race = &race;
+        threads[a].index = a;
+        pthread_create(&threads[a].thread, NULL, bandAttempt, &threads[a]);
+    }
+
+    long long work = 0, useful = 0;
+    *candidates = 0;
+    for (int a = 0; a < attempts; a++)
+    {
+        pthread_join(threads[a].thread, NULL);
+        work += threads[a].work;
+        useful += threads[a].winningWork;
+        *candidates += threads[a].candidates;
+    }
+    free(threads);
+
+    *out = race.result;
+    out->emptyCells = 0;
+    for (int cell = 0; cell < N * N; cell++)
+        out->emptyCells += out->unsolved[cell / N][cell % N] == 0;
+    return work > 0 ? (double)(work - useful) / work : 0;
+}
+
+// Serve speculative band requests and report the wasted work
+int runBand(int argc, char *argv[])
+{
+    int band = BAND_INVALID;
+    for (int b = BAND_EASY; b < BAND_COUNT; b++)
+        if (strcmp(argv[2], bandName(b)) == 0)
+            band = b;
+    int attempts = (int)optionNumber(argc, argv, "attempts", (double)sysconf(_SC_NPROCESSORS_ONLN));
+    int count = (int)optionNumber(argc, argv, "count", 10);
+
+    if (band == BAND_INVALID || attempts < 1 || count < 1)
+    {
+        printf("Invalid band options!\n");
+        return 1;
+    }
+
+    struct sudoku_board puzzle;
+    double wasted = 0, slowest = 0, total = 0;
+    int candidates, allCandidates = 0;
+    for (int r = 0; r < count; r++)
+    {
+        long long start = nowNanoseconds();
+        wasted += generateInBand(band, attempts, &puzzle, &candidates);
+        double ms = (nowNanoseconds() - start) / 1e6;
+        total += ms;
+        slowest = ms > slowest ? ms : slowest;
+        allCandidates += candidates;
+        printf("request %3d: %7.2f ms, %4d candidates, %d empty cells\n", r + 1, ms, candidates, puzzle.emptyCells);
+    }
+    printf("%s band with %d attempts: %.2f ms mean, %.2f ms slowest, %.1f candidates per request, wasted work %.1f%%\n",
+           bandName(band), attempts, total / count, slowest, (double)allCandidates / count, 100 * wasted / count);
+    return 0;
+}
+
+
+/* =========== Metrics =========== */
+
+// Every recording thread owns a struct thread_metrics and is its only writer, so a
+// record is a few plain loads and stores (relaxed atomics, no locked instructions).
+// The scraper reads all registered threads and merges them. Histograms are HDR style:
+// values below 64 ns have their own bucket, above that every power of two is split in
+// 32 buckets, so any value is known within 3%.
+
+// bucket of a value in an HDR histogram
+static int hdrBucket(long long ns)
+{
+    unsigned long long v = ns > 0 ? (unsigned long long)ns : 0;
+    if (v < (1ULL << HDR_SUB_BITS))
+        return (int)v;
+    int shift = 63 - __builtin_clzll(v) - (HDR_SUB_BITS - 1);
+    int bucket = shift * (1 << (HDR_SUB_BITS - 1)) + (int)(v >> shift);
+    return bucket < HDR_BUCKETS ? bucket : HDR_BUCKETS - 1;
+}
+
+// lowest value of an HDR bucket
+static long long hdrBucketValue(int bucket)
+{
+    int half = 1 << (HDR_SUB_BITS - 1);
+    if (bucket < 2 * half)
+        return bucket;
+    int shift = bucket / half - 1;
+    return (long long)(bucket % half + half) << shift;
+}
+
+// Start recording metrics on this thread, returns false if the registry is full
+bool metricsRegister()
+{
+    if (threadMetrics != NULL)
+        return true;
+    struct thread_metrics *metrics = aligned_alloc(CACHE_LINE, sizeof(struct thread_metrics));
+    if (metrics == NULL)
+        return false;
+    memset(metrics, 0, sizeof(*metrics));
+
+    int slot = atomic_fetch_add(&metricsThreads, 1);
+    if (slot >= METRIC_THREADS)
+    {
+        free(metrics);
+        return false;
+    }
+    // the slot is counted before it is stored, a scrape in between skips it
+    atomic_store_explicit(&metricsRegistry[slot], metrics, memory_order_release);
+    threadMetrics = metrics;
+    return true;
+}
+
+// add one to a counter with a single writer, without a locked instruction
+static inline void metricsAdd(_Atomic long long *value, long long amount)
+{
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+// Record a latency of this thread, does nothing if the thread does not record
+void metricsRecord(int histogram, long long ns)
+{
+    if (threadMetrics == NULL)
+        return;
+    struct hdr_histogram *h = &threadMetrics->histograms[histogram];
+    metricsAdd(&h->counts[hdrBucket(ns)], 1);
+    metricsAdd(&h->total, 1);
+    metricsAdd(&h->sum, ns);
+}
+
+// Add to a counter of this thread, does nothing if the thread does not record
+void metricsCount(int counter, long long amount)
+{
+    if (threadMetrics != NULL)
+        metricsAdd(&threadMetrics->counters[counter], amount);
+}
+
+// Merge all threads into the Prometheus text format
+// returns the length of the text, the text is cut short if buf is too small
+int metricsText(char *buf, int size)
+{
+    static const char *histogramNames[METRIC_HISTOGRAMS] = {"generate", "solve", "grade"};
+    static const char *histogramHelp[METRIC_HISTOGRAMS] = {"fillValues()", "countSolutions()", "gradePuzzle()"};
+    static const char *counterNames[METRIC_COUNTERS] = {"puzzles_generated", "backtracks", "timeouts", "cache_hits"};
+    static const char *counterHelp[METRIC_COUNTERS] = {
+        "Puzzles generated", "Digits taken back by the fill search",
+        "Requests slower than the deadline", "Search results found in the cache"};
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    static long long merged[HDR_BUCKETS];
+    int length = 0, threads = atomic_load(&metricsThreads);
+
+    threads = threads < METRIC_THREADS ? threads : METRIC_THREADS;
+    for (int c = 0; c < METRIC_COUNTERS; c++)
+    {
+        long long total = 0;
+        for (int t = 0; t < threads; t++)
+        {
+            struct thread_metrics *metrics = atomic_load_explicit(&metricsRegistry[t], memory_order_acquire);
+            if (metrics != NULL)
+                total += atomic_load_explicit(&metrics->counters[c], memory_order_relaxed);
+        }
+        length += snprintf(buf + length, length < size ? size - length : 0,
+                           "# HELP sudoku_%s_total %s.\n# TYPE sudoku_%s_total counter\nsudoku_%s_total %lld\n",
+                           counterNames[c], counterHelp[c], counterNames[c], counterNames[c], total);
+    }
+
+    for (int m = 0; m < METRIC_HISTOGRAMS; m++)
+    {
+        long long total = 0, sum = 0;
+        memset(merged, 0, sizeof(merged));
+        for (int t = 0; t < threads; t++)
+        {
+            struct thread_metrics *metrics = atomic_load_explicit(&metricsRegistry[t], memory_order_acquire);
+            if (metrics == NULL)
+                continue;
+            struct hdr_histogram *h = &metrics->histograms[m];
+            for (int b = 0; b < HDR_BUCKETS; b++)
+                merged[b] += atomic_load_explicit(&h->counts[b], memory_order_relaxed);
+            sum += atomic_load_explicit(&h->sum, memory_order_relaxed);
+        }
+        for (int b = 0; b < HDR_BUCKETS; b++)
+            total += merged[b];
+
+        length += snprintf(buf + length, length < size ? size - length : 0,
+                           "# HELP sudoku_%s_seconds Time of %s.\n# TYPE sudoku_%s_seconds summary\n",
+                           histogramNames[m], histogramHelp[m], histogramNames[m]);
+        long long seen = 0;
+        int b = 0;
+        for (int q = 0; q < (int)(sizeof(quantiles) / sizeof(quantiles[0])); q++)
+        {
+            while (b < HDR_BUCKETS - 1 && (seen + merged[b] < quantiles[q] * total || merged[b] == 0))
+                seen += merged[b++];
+            length += snprintf(buf + length, length < size ? size - length : 0,
+                               "sudoku_%s_seconds{quantile=\"%g\"} %.9f\n", histogramNames[m], quantiles[q],
+                               total > 0 ? hdrBucketValue(b) / 1e9 : 0.0);
+        }
+        length += snprintf(buf + length, length < size ? size - length : 0,
+                           "sudoku_%s_seconds_sum %.9f\nsudoku_%s_seconds_count %lld\n",
+                           histogramNames[m], sum / 1e9, histogramNames[m], total);
+    }
+    return length < size ? length : size - 1;
+}
+
+
+/* =========== Service Mode =========== */
+
+// --service keeps worker threads generating, solving and grading puzzles and serves
+// the merged metrics at GET /metrics on a local HTTP listener. Options (name=value):
+//   threads   number of workers (default: number of cores)
+//   level     number of empty cells (default HARD_LVL)
+//   deadline  requests slower than this many ms count as timeouts (default 50)
+//   seconds   stop after this many seconds, 0 to run forever (default 0)
+//   metrics   where to listen: host:port or unix:/path (default 127.0.0.1:9100)
+
+// Options of a service worker
+struct service_worker {
+    pthread_t thread;
+    int difficulty;
+    long long deadline;     // ns
+    unsigned int seed;
+    _Atomic bool *stop;
+};
+
+// thread function of a service worker
+static void *serviceWorker(void *arg)
+{
+    struct service_worker *worker = arg;
+    struct grade_report report;
+
+    if (!metricsRegister())
+        return NULL;
+    seedRandom(worker->seed);
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed))
+    {
+        long long start = nowNanoseconds();
+        resetBoard();
+        board.emptyCells = worker->difficulty;
+        fillValues();
+        long long generated = nowNanoseconds();
+        countSolutions(board.unsolved, 2);
+        long long solved = nowNanoseconds();
+        gradePuzzle(board.unsolved, &report);
+        long long graded = nowNanoseconds();
+
+        metricsRecord(METRIC_GENERATE, generated - start);
+        metricsRecord(METRIC_SOLVE, solved - generated);
+        metricsRecord(METRIC_GRADE, graded - solved);
+        metricsCount(METRIC_PUZZLES, 1);
+        if (graded - start > worker->deadline)
+            metricsCount(METRIC_TIMEOUTS, 1);
+    }
+    return NULL;
+}
+
+// open the metrics listener on host:port or unix:/path, returns the socket or -1
+static int serviceListen(const char *where)
+{
+    int fd;
+    if (strncmp(where, "unix:", 5) == 0)
+    {
+        struct sockaddr_un address = {.sun_family = AF_UNIX};
+        if (strlen(where + 5) >= sizeof(address.sun_path))
+            return -1;
+        strcpy(address.sun_path, where + 5);
+        unlink(address.sun_path); // a stale socket from an earlier run
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+            return -1;
+    }
+    else
+    {
+        char host[64];
+        const char *colon = strrchr(where, ':');
+        struct sockaddr_in address = {.sin_family = AF_INET};
+        if (colon == NULL || colon - where >= (int)sizeof(host))
+            return -1;
+        memcpy(host, where, colon - where);
+        host[colon - where] = 0;
+        address.sin_port = htons((unsigned short)atoi(colon + 1));
+        if (inet_pton(AF_INET, host, &address.sin_addr) != 1)
+            return -1;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        if (fd < 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+            return -1;
+    }
+    return listen(fd, 16) == 0 ? fd : -1;
+}
+
+// answer one HTTP request on a connection
+static void serviceAnswer(int connection)
+{
+    static char body[65536], head[256];
+    char request[1024];
+    ssize_t got = read(connection, request, sizeof(request) - 1);
+    if (got <= 0)
+        return;
+    request[got] = 0;
+
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0)
+    {
+        int length = metricsText(body, sizeof(body));
+        int headLength = sprintf(head, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                       "Content-Length: %d\r\nConnection: close\r\n\r\n", length);
+        // a scraper that hangs up early must not kill the service with SIGPIPE
+        if (send(connection, head, headLength, MSG_NOSIGNAL) == headLength)
+            (void)!send(connection, body, length, MSG_NOSIGNAL);
+    }
+    else
+    {
+        const char *notFound = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        (void)!send(connection, notFound, strlen(notFound), MSG_NOSIGNAL);
+    }
+}
+
+// Generate puzzles and serve the metrics
+int runService(int argc, char *argv[])
+{
+    int threads = (int)optionNumber(argc, argv, "threads", (double)sysconf(_SC_NPROCESSORS_ONLN));
+    int difficulty = optionLevel(argc, argv, HARD_LVL);
+    double deadline = optionNumber(argc, argv, "deadline", 50);
+    double seconds = optionNumber(argc, argv, "seconds", 0);
+    const char *where = "127.0.0.1:9100";
+    for (int a = 2; a < argc; a++)
+        if (strncmp(argv[a], "metrics=", 8) == 0)
+            where = argv[a] + 8;
+
+    if (threads < 1 || threads >= METRIC_THREADS || difficulty < 0 || difficulty > MAX_EMPTY_CELLS || deadline < 0 ||
+        seconds < 0)
+    {
+        printf("Invalid service options!\n");
+        return 1;
+    }
+    int listener = serviceListen(where);
+    if (listener < 0)
+    {
+        printf("Cannot start the service on %s!\n", where);
+        return 1;
+    }
+    printf("Serving metrics on %s with %d workers\n", where, threads);
+    fflush(stdout);
+
+    static _Atomic bool stop;
+    struct service_worker *workers = calloc(threads, sizeof(struct service_worker));
+    if (workers == NULL)
+        return 1;
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t].difficulty = difficulty;
+        workers[t].deadline = (long long)(deadline * 1e6);
+        workers[t].seed = (unsigned int)time(NULL) + (unsigned int)t * 1000003u;
+        workers[t].stop = &stop;
+        pthread_create(&workers[t].thread, NULL, serviceWorker, &workers[t]);
+    }
+
+    // answer scrapes until the time is up, the listener wakes up every 100 ms to check
+    long long end = seconds > 0 ? nowNanoseconds() + (long long)(seconds * 1e9) : 0;
+    int loop = epoll_create1(0);
+    struct epoll_event watch = {.events = EPOLLIN};
+    watch.data.fd = listener;
+    epoll_ctl(loop, EPOLL_CTL_ADD, listener, &watch);
+    while (end == 0 || nowNanoseconds() < end)
+    {
+        struct epoll_event event;
+        if (epoll_wait(loop, &event, 1, 100) == 1)
+        {
+            int connection = accept(listener, NULL, NULL);
+            if (connection >= 0)
+            {
+                struct timeval slow = {1, 0}; // a client that sends nothing does not stall the loop
+                setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &slow, sizeof(slow));
+                serviceAnswer(connection);
+                close(connection);
+            }
+        }
+    }
+
+    atomic_store(&stop, true);
+    for (int t = 0; t < threads; t++)
+        pthread_join(workers[t].thread, NULL);
+    free(workers);
+    close(loop);
+    close(listener);
+    return 0;
+}
+
+// Measure the cost of recording a latency
+void benchmarkMetrics(int count)
+{
+    metricsRegister();
+    long long start = nowNanoseconds();
+    for (int r = 0; r < count; r++)
+        metricsRecord(METRIC_SOLVE, (r * 2654435761u) & 0xFFFFF); // spread over many buckets
+    long long end = nowNanoseconds();
+    printf("%.1f ns per recorded latency\n", (double)(end - start) / count);
+}
+
+
+/* =========== Bitboard Solver =========== */
+
+// Every digit has a bitboard of the cells where it can still go, split into three bands
+// of three rows (27 bits each). Rows and boxes lie inside one band and a column is three
+// bits in every band, so placing a digit is a handful of ANDs with the peer bitboard of
+// the cell. Naked singles come out of counting candidates over all nine planes with bit
+// arithmetic, and hidden singles out of the planes masked with every unit. When singles
+// run out the solver guesses a digit, on a cell with two candidates when there is one,
+// and keeps the board without that digit on an explicit stack to go back to.
+
+// put digit d (0 to 8) in a cell of a bitboard
+static inline void bitboardPlace(struct bitboard *bb, int cell, int d)
+{
+    int band = cell / BAND_CELLS;
+    unsigned int bit = 1u << (cell % BAND_CELLS);
+    for (int e = 0; e < N; e++)
+        bb->planes[e][band] &= ~bit; // the cell has no other candidates
+    for (int b = 0; b < MINI_BOX_SIZE; b++)
+        bb->planes[d][b] &= ~peerBands[cell][b]; // the peers lose the digit
+    bb->planes[d][band] |= bit;
+    bb->unsolved[band] &= ~bit;
+}
+
+// place naked and hidden singles until there are none, returns false on a contradiction
+static bool bitboardPropagate(struct bitboard *bb)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+
+        // naked singles: unsolved cells with exactly one candidate
+        for (int b = 0; b < MINI_BOX_SIZE; b++)
+        {
+            unsigned int open = bb->unsolved[b], ones = 0, twos = 0;
+            if (open == 0)
+                continue;
+            for (int d = 0; d < N; d++)
+            {
+                unsigned int x = bb->planes[d][b] & open;
+                twos |= ones & x;
+                ones |= x;
+            }
+            if (open & ~ones)
+                return false; // a cell without candidates
+            for (unsigned int singles = ones & ~twos; singles != 0; singles &= singles - 1)
+            {
+                unsigned int bit = singles & -singles;
+                int d = 0;
+                while (d < N && !(bb->planes[d][b] & bit))
+                    d++;
+                if (d == N)
+                    return false; // lost its last candidate to an earlier single
+                bitboardPlace(bb, b * BAND_CELLS + __builtin_ctz(bit), d);
+                changed = true;
+            }
+        }
+        if (changed)
+            continue;
+
+        // hidden singles: a digit with one place left in a unit, all rows, columns and
+        // boxes at once by folding the three 9 bit rows of each band
+        for (int d = 0; d < N; d++)
+        {
+            unsigned int colOnes = 0, colTwos = 0, hits[MINI_BOX_SIZE];
+            for (int b = 0; b < MINI_BOX_SIZE; b++)
+            {
+                unsigned int plane = bb->planes[d][b];
+                unsigned int r0 = plane & 0x1FF, r1 = (plane >> 9) & 0x1FF, r2 = plane >> 18;
+                if (r0 == 0 || r1 == 0 || r2 == 0)
+                    return false; // the digit has no place in a row
+                hits[b] = ((r0 & (r0 - 1)) ? 0 : r0) | ((r1 & (r1 - 1)) ? 0 : r1 << 9) |
+                          ((r2 & (r2 - 1)) ? 0 : r2 << 18);
+
+                // columns of the band with the digit once, and twice or more
+                unsigned int ones = r0 | r1 | r2, twos = (r0 & r1) | (r0 & r2) | (r1 & r2);
+
+                // boxes: fold the three columns of every box to its first column
+                unsigned int boxOnes = (ones | ones >> 1 | ones >> 2) & 0x49;
+                unsigned int boxTwos = (twos | twos >> 1 | twos >> 2 | (ones & ones >> 1) |
+                                        (ones & ones >> 2) | (ones >> 1 & ones >> 2)) & 0x49;
+                if (boxOnes != 0x49)
+                    return false; // the digit has no place in a box
+                unsigned int box = boxOnes & ~boxTwos;
+                box |= box << 1 | box << 2;
+                hits[b] |= plane & (box | box << 9 | box << 18);
+
+                colTwos |= twos | (colOnes & ones);
+                colOnes |= ones;
+            }
+            if (colOnes != 0x1FF)
+                return false; // the digit has no place in a column
+            unsigned int col = colOnes & ~colTwos;
+            col |= col << 9 | col << 18;
+
+            // place the singles that are not placed digits already
+            for (int b = 0; b < MINI_BOX_SIZE; b++)
+            {
+                for (unsigned int cells = (hits[b] | (bb->planes[d][b] & col)) & bb->unsolved[b]; cells != 0;
+                     cells &= cells - 1)
+                {
+                    unsigned int bit = cells & -cells;
+                    if (!(bb->planes[d][b] & bit))
+                        return false; // two singles of the digit see each other
+                    bitboardPlace(bb, b * BAND_CELLS + __builtin_ctz(bit), d);
+                    changed = true;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// pick the cell to guess on: one with two candidates, or else the one with the fewest
+static int bitboardGuessCell(const struct bitboard *bb)
+{
+    int cell = -1, fewest = N + 1;
+    for (int b = 0; b < MINI_BOX_SIZE; b++)
+    {
+        unsigned int open = bb->unsolved[b], ones = 0, twos = 0, threes = 0;
+        for (int d = 0; d < N; d++)
+        {
+            unsigned int x = bb->planes[d][b] & open;
+            threes |= twos & x;
+            twos |= ones & x;
+            ones |= x;
+        }
+        unsigned int pairs = twos & ~threes;
+        if (pairs != 0)
+            return b * BAND_CELLS + __builtin_ctz(pairs);
+        for (; open != 0; open &= open - 1)
+        {
+            unsigned int bit = open & -open;
+            int count = 0;
+            for (int d = 0; d < N; d++)
+                count += (bb->planes[d][b] & bit) != 0;
+            if (count < fewest)
+            {
+                fewest = count;
+                cell = b * BAND_CELLS + __builtin_ctz(bit);
+            }
+        }
+    }
+    return cell;
+}
+
+// Solve with the bitboard engine, returns the number of solutions up to limit
+// solution may be NULL, otherwise it gets the first solution
+int bitboardSolve(const int grid[N][N], int solution[N][N], int limit)
+{
+    struct bitboard stack[N * N], bb;
+    int depth = 0, solutions = 0;
+
+    for (int d = 0; d < N; d++)
+        for (int b = 0; b < MINI_BOX_SIZE; b++)
+            bb.planes[d][b] = BAND_FULL;
+    for (int b = 0; b < MINI_BOX_SIZE; b++)
+        bb.unsolved[b] = BAND_FULL;
+
+    for (int cell = 0; cell < N * N; cell++)
+    {
+        int num = grid[cell / N][cell % N];
+        if (num == 0)
+            continue;
+        if (num < 1 || num > N || !(bb.planes[num - 1][cell / BAND_CELLS] & (1u << (cell % BAND_CELLS))))
+            return 0; // the clues break the rules
+        bitboardPlace(&bb, cell, num - 1);
+    }
+
+    for (;;)
+    {
+        if (!bitboardPropagate(&bb))
+        {
+            if (depth == 0)
+                break;
+            bb = stack[--depth];
+            continue;
+        }
+        if ((bb.unsolved[0] | bb.unsolved[1] | bb.unsolved[2]) == 0)
+        {
+            if (solutions++ == 0 && solution != NULL)
+                for (int cell = 0; cell < N * N; cell++)
+                    for (int d = 0; d < N; d++)
+                        if (bb.planes[d][cell / BAND_CELLS] & (1u << (cell % BAND_CELLS)))
+                            solution[cell / N][cell % N] = d + 1;
+            if (solutions >= limit || depth == 0)
+                break;
+            bb = stack[--depth];
+            continue;
+        }
+
+        // try the lowest candidate of the cell, the board without it waits on the stack
+        int cell = bitboardGuessCell(&bb), band = cell / BAND_CELLS;
+        unsigned int bit = 1u << (cell % BAND_CELLS);
+        int d = 0;
+        while (!(bb.planes[d][band] & bit))
+            d++;
+        stack[depth] = bb;
+        stack[depth++].planes[d][band] &= ~bit;
+        bitboardPlace(&bb, cell, d);
+    }
+    return solutions;
+}
+
+// Compare the bitboard engine with the backtracking search
+// puzzles come from a file (81 characters per line, 0 or . for empty cells), or else
+// from a few well known hard puzzles and generated ones
+void benchmarkSolve(const char *path, int count)
+{
+    static const char *hard[] = {
+        "1....7.9..3..2...8..96..5....53..9...1..8...26....4...3......1..4......7..7...3..",  // AI Escargot
+        "1.......2.9.4...5...6...7...5.9.3.......7.......85..4.7.....6...3...9.8...2.....1",  // Easter Monster
+        ".......39.....1..5..3.5.8....8.9...6.7...2...1..4.......9.8..5..2....6..4..7.....",  // Golden Nugget
+        "8..........36......7..9.2...5...7.......457.....1...3...1....68..85...1..9....4..",  // Arto Inkala 2012
+        "4.....8.5.3..........7......2.....6.....8.4......1.......6.3.7.5..2.....1.4......",  // Norvig's hardest
+    };
+    int (*puzzles)[N][N] = malloc(count * sizeof(*puzzles));
+    int total = 0, solution[N][N];
+
+    if (puzzles == NULL)
+        return;
+
+    FILE *file = path != NULL ? fopen(path, "r") : NULL;
+    if (path != NULL && file == NULL)
+        printf("Cannot open %s, using built in puzzles\n", path);
+    char *line = NULL;
+    size_t capacity = 0;
+    // whole lines, the solution and a solve path of a bank line are skipped after the puzzle
+    while (file != NULL && total < count && getline(&line, &capacity, file) != -1)
+    {
+        if (strcspn(line, " \t\r\n") < N * N)
+            continue;
+        for (int c = 0; c < N * N; c++)
+            puzzles[total][c / N][c % N] = line[c] >= '1' && line[c] <= '9' ? line[c] - '0' : 0;
+        total++;
+    }
+    free(line);
+    if (file != NULL)
+        fclose(file);
+
+    // without a file: the hard puzzles first, then unique generated puzzles
+    seedRandom((unsigned int)time(NULL));
+    for (int h = 0; file == NULL && h < (int)(sizeof(hard) / sizeof(hard[0])) && total < count; h++, total++)
+        for (int c = 0; c < N * N; c++)
+            puzzles[total][c / N][c % N] = hard[h][c] == '.' ? 0 : hard[h][c] - '0';
+    while (file == NULL && path == NULL && total < count)
+    {
+        resetBoard();
+        board.emptyCells = HARD_LVL + randomGenerator(15);
+        fillValues();
+        if (countSolutionsMasks(board.unsolved, 2) == 1)
+            memcpy(puzzles[total++], board.unsolved, sizeof(board.unsolved));
+    }
+
+    struct perf_counters counters[2];
+    perfOpen(&counters[0]);
+    perfOpen(&counters[1]);
+
+    perfStart(&counters[0]);
+    long long start = nowNanoseconds(), unique = 0;
+    for (int k = 0; k < total; k++)
+        unique += bitboardSolve(puzzles[k], solution, 2) == 1;
+    long long bitboard = nowNanoseconds() - start;
+    perfStop(&counters[0]);
+
+    perfStart(&counters[1]);
+    start = nowNanoseconds();
+    for (int k = 0; k < total; k++)
+        countSolutionsMasks(puzzles[k], 2);
+    long long masks = nowNanoseconds() - start;
+    perfStop(&counters[1]);
+
+    // the hard puzzles alone, repeated so the time is measurable
+    if (path == NULL)
+    {
+        start = nowNanoseconds();
+        for (int r = 0; r < 200; r++)
+            for (int h = 0; h < 5 && h < total; h++)
+                bitboardSolve(puzzles[h], solution, 2);
+        long long hardTime = nowNanoseconds() - start;
+        printf("Famous hard puzzles: %.1f us per puzzle, %.0f puzzles per second\n",
+               hardTime / 1000.0 / (200 * 5), 200 * 5 / (hardTime / 1e9));
+    }
+    printf("%d puzzles, %lld with a unique solution (checked up to 2 solutions)\n", total, unique);
+    printf("Bitboard engine: %.2f us per puzzle, %.0f puzzles per second\n", bitboard / 1000.0 / total,
+           total / (bitboard / 1e9));
+    printf("Backtracking: %.2f us per puzzle, %.0f puzzles per second\n", masks / 1000.0 / total,
+           total / (masks / 1e9));
+    perfReport(&counters[0], "Bitboard engine", total, "puzzle");
+    perfReport(&counters[1], "Backtracking", total, "puzzle");
+    perfClose(&counters[0]);
+    perfClose(&counters[1]);
+    free(puzzles);
+}
+
+
+/* =========== Grid Validator =========== */
+
+// isBoardSolved() compares with the stored solution, which rejects any other completion
+// of a puzzle that is not unique. The validator checks the rules instead: every cell
+// becomes a digit bit (0 for anything that is not 1 to 9), the bits are ORed into the
+// masks of the rows, columns and boxes and each of the 27 masks has to hold all nine
+// digits. The clues are compared the same way, so there is no branch per cell and the
+// loops vectorize at -O3.
+
+// Check a completed grid against the rules, and against the clues unless clues is NULL
+bool validateGrid(const int grid[N][N], const int clues[N][N])
+{
+    const int *cells = &grid[0][0];
+    unsigned int bits[N * N], cols[N] = {0}, all = ALL_DIGITS;
+    int wrong = 0;
+
+    for (int cell = 0; cell < N * N; cell++)
+    {
+        unsigned int value = (unsigned int)cells[cell];
+        bits[cell] = (unsigned int)(value - 1 < N) << (value & 15);
+    }
+    for (int band = 0; band < N; band += MINI_BOX_SIZE)
+    {
+        // the three rows of a band folded per column give the columns and the boxes
+        unsigned int folded[N];
+        for (int j = 0; j < N; j++)
+        {
+            folded[j] = bits[band * N + j] | bits[(band + 1) * N + j] | bits[(band + 2) * N + j];
+            cols[j] |= folded[j];
+        }
+        for (int k = 0; k < N; k += MINI_BOX_SIZE)
+            all &= folded[k] | folded[k + 1] | folded[k + 2];
+    }
+    for (int k = 0; k < N; k++)
+    {
+        const unsigned int *row = &bits[k * N];
+        all &= cols[k] & (row[0] | row[1] | row[2] | row[3] | row[4] | row[5] | row[6] | row[7] | row[8]);
+    }
+
+    if (clues != NULL)
+    {
+        const int *given = &clues[0][0];
+        for (int cell = 0; cell < N * N; cell++)
+            wrong |= (given[cell] != 0) & (given[cell] != cells[cell]);
+    }
+    return (all == ALL_DIGITS) & !wrong;
+}
+
+// Validate count grids, clues may be NULL and valid may be NULL
+// valid gets 1 for every grid that passes, returns the number that pass
+int validateGrids(const int (*grids)[N][N], const int (*clues)[N][N], int count, unsigned char *valid)
+{
+    int passed = 0;
+    for (int k = 0; k < count; k++)
+    {
+        bool ok = validateGrid(grids[k], clues != NULL ? clues[k] : NULL);
+        if (valid != NULL)
+            valid[k] = ok;
+        passed += ok;
+    }
+    return passed;
+}
+
+// Measure the validator on a batch of grids, every fourth one with two cells swapped
+void benchmarkValidate(int count)
+{
+    enum { DISTINCT = 64 };
+    int (*grids)[N][N] = malloc(count * sizeof(*grids)), (*clues)[N][N] = malloc(count * sizeof(*clues));
+    unsigned char *valid = malloc(count);
+
+    if (grids == NULL || clues == NULL || valid == NULL)
+    {
+        free(grids);
+        free(clues);
+        free(valid);
+        return;
+    }
+
+    seedRandom((unsigned int)time(NULL));
+    for (int k = 0; k < count; k++)
+    {
+        if (k < DISTINCT)
+        {
+            resetBoard();
+            board.emptyCells = MEDIUM_LVL;
+            fillValues();
+            memcpy(grids[k], board.solved, sizeof(board.solved));
+            memcpy(clues[k], board.unsolved, sizeof(board.unsolved));
+        }
+        else
+        {
+            memcpy(grids[k], grids[k % DISTINCT], sizeof(grids[k]));
+            memcpy(clues[k], clues[k % DISTINCT], sizeof(clues[k]));
+        }
+    }
+    for (int k = 0; k < count; k += 4)
+    {
+        int row = randomGenerator(N) - 1, a = randomGenerator(N) - 1, b = (a + randomGenerator(N - 1)) % N;
+        int swap = grids[k][row][a];
+        grids[k][row][a] = grids[k][row][b];
+        grids[k][row][b] = swap;
+    }
+
+    long long start = nowNanoseconds();
+    int rules = validateGrids((const int (*)[N][N])grids, NULL, count, valid);
+    long long middle = nowNanoseconds();
+    int passed = validateGrids((const int (*)[N][N])grids, (const int (*)[N][N])clues, count, valid);
+    long long end = nowNanoseconds();
+
+    printf("%d grids, %d keep the rules, %d also keep the clues (expected %d)\n", count, rules, passed,
+           count - (count + 3) / 4);
+    printf("Rules only: %.1f ns per grid\n", (double)(middle - start) / count);
+    printf("Rules and clues: %.1f ns per grid\n", (double)(end - middle) / count);
+    free(grids);
+    free(clues);
+    free(valid);
+}
+
+
+/* =========== Transposition Table =========== */
+
+// Counting the solutions of puzzles that differ in a few clues, like the checks of a minimal
+// puzzle generator, reaches the same boards again and again. Every board has a Zobrist hash,
+// the XOR of a random key per digit and cell, which a move updates with one XOR. The table
+// keeps the count of a finished subtree (none, one, or two and more) per hash in a single
+// word, so threads share it without locks: a torn or overwritten entry is just a miss.
+
+// Zobrist hash of the digits of a grid
+unsigned long long zobristHash(const int grid[N][N])
+{
+    unsigned long long hash = 0;
+    for (int cell = 0; cell < N * N; cell++)
+        hash ^= zobristKeys[cell][grid[cell / N][cell % N]];
+    return hash;
+}
+
+// Turn on the transposition table with 2^bits entries of 8 bytes, false if out of memory
+bool transpositionInit(int bits)
+{
+    if (bits < 1 || bits > 32)
+        return false;
+    transpositionFree();
+    transposition.entries = calloc(1ull << bits, sizeof(*transposition.entries));
+    transposition.mask = (1ull << bits) - 1;
+    return transposition.entries != NULL;
+}
+
+// Turn off the transposition table
+void transpositionFree()
+{
+    free((void *)transposition.entries);
+    transposition.entries = NULL;
+    transposition.mask = 0;
+}
+
+// Remove clues in random order while the solution stays unique, returns the clues left
+int minimizePuzzle(int grid[N][N])
+{
+    int order[N * N], clues = 0;
+    for (int cell = 0; cell < N * N; cell++)
+        order[cell] = cell;
+    for (int k = N * N - 1; k > 0; k--)
+    {
+        int other = randomGenerator(k + 1) - 1, swap = order[k];
+        order[k] = order[other];
+        order[other] = swap;
+    }
+    for (int k = 0; k < N * N; k++)
+    {
+        int i = order[k] / N, j = order[k] % N, num = grid[i][j];
+        if (num == 0)
+            continue;
+        grid[i][j] = 0;
+        if (countSolutionsMasks(grid, 2) != 1)
+        {
+            grid[i][j] = num; // the clue is needed
+            clues++;
+        }
+    }
+    return clues;
+}
+
+// Compare the counting search with and without the table on minimal puzzle generation
+void benchmarkTransposition(int count, int bits)
+{
+    int grid[N][N];
+    long long nodes[2], elapsed[2], clues[2];
+    unsigned int seed = (unsigned int)time(NULL);
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1 && !transpositionInit(bits))
+        {
+            printf("Cannot allocate a table of 2^%d entries\n", bits);
+            return;
+        }
+        memset(&searchStats, 0, sizeof(searchStats));
+        clues[pass] = 0;
+        long long start = nowNanoseconds();
+        for (int k = 0; k < count; k++)
+        {
+            // the same solved grids and removal orders in both passes
+            seedRandom(seed + k);
+            resetBoard();
+            board.emptyCells = 0;
+            fillValues();
+            memcpy(grid, board.solved, sizeof(grid));
+            clues[pass] += minimizePuzzle(grid);
+        }
+        elapsed[pass] = nowNanoseconds() - start;
+        nodes[pass] = searchStats.nodes;
+    }
+
+    printf("%d minimal puzzles, %.1f clues on average%s\n", count, (double)clues[0] / count,
+           clues[0] == clues[1] ? "" : " (the passes differ!)");
+    printf("Without table: %lld nodes, %.2f ms per puzzle\n", nodes[0], elapsed[0] / 1e6 / count);
+    printf("With 2^%d entries: %lld nodes, %.2f ms per puzzle, %lld probes, %.1f%% hits\n", bits, nodes[1],
+           elapsed[1] / 1e6 / count, searchStats.probes,
+           searchStats.probes > 0 ? 100.0 * searchStats.hits / searchStats.probes : 0.0);
+    printf("Nodes saved: %.1f%%\n", nodes[0] > 0 ? 100.0 * (nodes[0] - nodes[1]) / nodes[0] : 0.0);
+    transpositionFree();
+}
+
+
+/* =========== Candidate Planes =========== */
+
+// isAbsentInRow() and friends scan the board for every question. The planes keep the
+// candidates in three views instead, updated together on every elimination: the digit mask
+// of a cell, the bitboard of a digit and the 9 bit positions of a digit in a unit. Subsets
+// and fish are the same search on the transposed views: k members of a unit (cells for a
+// naked subset, digits for a hidden one, rows or columns of one digit for a fish) whose
+// masks cover only k bits together.
+
+// Unit number of the box of a cell
+static inline int cellBox(int cell)
+{
+    return (cell / N / MINI_BOX_SIZE) * MINI_BOX_SIZE + cell % N / MINI_BOX_SIZE;
+}
+
+// Position of a cell in its box
+static inline int cellBoxPosition(int cell)
+{
+    return (cell / N % MINI_BOX_SIZE) * MINI_BOX_SIZE + cell % N % MINI_BOX_SIZE;
+}
+
+// Candidates of a grid in all views
+void planesInit(struct candidate_planes *cp, const int grid[N][N])
+{
+    memset(cp, 0, sizeof(*cp));
+    for (int cell = 0; cell < N * N; cell++)
+    {
+        cp->value[cell] = grid[cell / N][cell % N];
+        if (cp->value[cell] != 0)
+            continue;
+        cp->cells[cell] = ALL_DIGITS;
+        cp->left++;
+        for (int num = 1; num <= N; num++)
+        {
+            cp->digits[num][cell / BAND_CELLS] |= 1u << (cell % BAND_CELLS);
+            cp->positions[cell / N][num] |= 1 << (cell % N);
+            cp->positions[N + cell % N][num] |= 1 << (cell / N);
+            cp->positions[2 * N + cellBox(cell)][num] |= 1 << cellBoxPosition(cell);
+        }
+    }
+    for (int cell = 0; cell < N * N; cell++)
+    {
+        if (cp->value[cell] == 0)
+            continue;
+        cp->placed[cell / N] |= 1 << cp->value[cell];
+        cp->placed[N + cell % N] |= 1 << cp->value[cell];
+        cp->placed[2 * N + cellBox(cell)] |= 1 << cp->value[cell];
+        for (int p = 0; p < PEERS; p++)
+            planesEliminate(cp, cellPeers[cell][p], cp->value[cell]);
+    }
+}
+
+// Take a candidate out of all views
+void planesEliminate(struct candidate_planes *cp, int cell, int num)
+{
+    if (!(cp->cells[cell] & (1 << num)))
+        return;
+    cp->cells[cell] &= ~(1 << num);
+    cp->digits[num][cell / BAND_CELLS] &= ~(1u << (cell % BAND_CELLS));
+    cp->positions[cell / N][num] &= ~(1 << (cell % N));
+    cp->positions[N + cell % N][num] &= ~(1 << (cell / N));
+    cp->positions[2 * N + cellBox(cell)][num] &= ~(1 << cellBoxPosition(cell));
+}
+
+// Put a digit in a cell and take it from the candidates of the peers
+void planesPlace(struct candidate_planes *cp, int cell, int num)
+{
+    for (int other = 1; other <= N; other++)
+        planesEliminate(cp, cell, other);
+    for (int p = 0; p < PEERS; p++)
+        planesEliminate(cp, cellPeers[cell][p], num);
+    cp->placed[cell / N] |= 1 << num;
+    cp->placed[N + cell % N] |= 1 << num;
+    cp->placed[2 * N + cellBox(cell)] |= 1 << num;
+    cp->value[cell] = num;
+    cp->left--;
+}
+
+// Place naked and hidden singles until there are none, returns the number placed
+int planesSingles(struct candidate_planes *cp)
+{
+    int placed = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int cell = 0; cell < N * N; cell++)
+        {
+            unsigned int mask = cp->cells[cell];
+            if (mask != 0 && (mask & (mask - 1)) == 0)
+            {
+                planesPlace(cp, cell, __builtin_ctz(mask));
+                placed++;
+                changed = true;
+            }
+        }
+        for (int u = 0; u < UNITS; u++)
+            for (int num = 1; num <= N; num++)
+            {
+                unsigned int where = cp->positions[u][num];
+                if (where != 0 && (where & (where - 1)) == 0)
+                {
+                    planesPlace(cp, unitCells[u][__builtin_ctz(where)], num);
+                    placed++;
+                    changed = true;
+                }
+            }
+    }
+    return placed;
+}
+
+// Find the sets of size members of family whose masks cover size bits together
+// members with fewer than 2 or more than size bits are left out, every set found goes to
+// members[] as a bit per member and to cover[] as the union, returns the number found
+static int findSubsets(const unsigned short family[N], int size, unsigned short members[], unsigned short cover[],
+                       int max)
+{
+    int index[N], count = 0, open = 0, found = 0;
+    for (int k = 0; k < N; k++)
+    {
+        int bits = __builtin_popcount(family[k]);
+        open += bits != 0;
+        if (bits >= 2 && bits <= size)
+            index[count++] = k;
+    }
+    if (count < size || open <= size)
+        return 0; // a set of all the open members takes nothing from the others
+
+    // choose size of the count candidates in increasing order, dropping a prefix as soon
+    // as its union has more than size bits
+    int pick[4], depth = 0;
+    unsigned short unions[5] = {0};
+    pick[0] = -1;
+    while (depth >= 0 && found < max)
+    {
+        if (++pick[depth] > count - (size - depth))
+        {
+            depth--;
+            continue;
+        }
+        unions[depth + 1] = unions[depth] | family[index[pick[depth]]];
+        if (__builtin_popcount(unions[depth + 1]) > size)
+            continue;
+        if (depth + 1 < size)
+        {
+            pick[depth + 1] = pick[depth];
+            depth++;
+            continue;
+        }
+        members[found] = 0;
+        for (int k = 0; k < size; k++)
+            members[found] |= 1 << index[pick[k]];
+        cover[found++] = unions[size];
+    }
+    return found;
+}
+
+// Add a step to a solve path, steps past the end are dropped
+static void pathAdd(struct solve_path *path, unsigned int step)
+{
+    if (path->count >= SOLVE_PATH_STEPS)
+        return;
+    if ((step & PATH_NO_CELL) != PATH_NO_CELL)
+        path->stepOfCell[step & PATH_NO_CELL] = (unsigned char)path->count;
+    path->steps[path->count++] = step;
+}
+
+// Eliminate with naked subsets of size 2 to 4: size cells of a unit with only size digits
+// between them, the digits go from the other cells of the unit
+int nakedSubsets(struct candidate_planes *cp, int size, struct solve_path *path)
+{
+    int eliminated = 0;
+    unsigned short family[N], members[N * N], cover[N * N];
+    for (int u = 0; u < UNITS; u++)
+    {
+        for (int k = 0; k < N; k++)
+            family[k] = cp->cells[unitCells[u][k]];
+        int found = findSubsets(family, size, members, cover, N * N);
+        for (int f = 0; f < found; f++)
+        {
+            int before = eliminated;
+            for (unsigned int nums = cover[f]; nums != 0; nums &= nums - 1)
+            {
+                // the positions of the digit in the unit outside the subset
+                int num = __builtin_ctz(nums);
+                for (unsigned int where = cp->positions[u][num] & ~members[f]; where != 0; where &= where - 1)
+                {
+                    planesEliminate(cp, unitCells[u][__builtin_ctz(where)], num);
+                    eliminated++;
+                }
+            }
+            if (path != NULL && eliminated > before)
+                pathAdd(path, pathStep(STEP_NAKED_SUBSET, PATH_NO_CELL, 0, u, members[f]));
+        }
+    }
+    return eliminated;
+}
+
+// Eliminate with hidden subsets of size 2 to 4: size digits that fit only in size cells of
+// a unit, the other digits go from those cells
+int hiddenSubsets(struct candidate_planes *cp, int size, struct solve_path *path)
+{
+    int eliminated = 0;
+    unsigned short family[N], members[N * N], cover[N * N];
+    for (int u = 0; u < UNITS; u++)
+    {
+        for (int num = 1; num <= N; num++)
+            family[num - 1] = cp->positions[u][num];
+        int found = findSubsets(family, size, members, cover, N * N);
+        for (int f = 0; f < found; f++)
+        {
+            unsigned int others = (unsigned int)ALL_DIGITS & ~((unsigned int)members[f] << 1);
+            int before = eliminated;
+            for (unsigned int where = cover[f]; where != 0; where &= where - 1)
+            {
+                int cell = unitCells[u][__builtin_ctz(where)];
+                eliminated += __builtin_popcount(cp->cells[cell] & others);
+                for (unsigned int nums = cp->cells[cell] & others; nums != 0; nums &= nums - 1)
+                    planesEliminate(cp, cell, __builtin_ctz(nums));
+            }
+            if (path != NULL && eliminated > before)
+                pathAdd(path, pathStep(STEP_HIDDEN_SUBSET, PATH_NO_CELL, 0, u, members[f]));
+        }
+    }
+    return eliminated;
+}
+
+// Eliminate with fish of size 2 (X-Wing), 3 (Swordfish) or 4 (Jellyfish): size rows where
+// a digit fits only in size columns take the digit from the rest of those columns, and the
+// same with rows and columns swapped
+int fishPatterns(struct candidate_planes *cp, int size, struct solve_path *path)
+{
+    int eliminated = 0;
+    unsigned short family[N], members[N * N], cover[N * N];
+    for (int num = 1; num <= N; num++)
+    {
+        for (int base = 0; base < 2; base++) // rows, then columns
+        {
+            for (int k = 0; k < N; k++)
+                family[k] = cp->positions[base * N + k][num];
+            int found = findSubsets(family, size, members, cover, N * N);
+            for (int f = 0; f < found; f++)
+            {
+                // the cells of the covering lines outside the base lines, as a digit plane
+                unsigned int targets[MINI_BOX_SIZE] = {0};
+                for (int line = 0; line < N; line++)
+                    for (unsigned int cross = cover[f]; !(members[f] & (1 << line)) && cross != 0; cross &= cross - 1)
+                    {
+                        int other = __builtin_ctz(cross);
+                        int cell = base == 0 ? line * N + other : other * N + line;
+                        targets[cell / BAND_CELLS] |= 1u << (cell % BAND_CELLS);
+                    }
+                int before = eliminated;
+                for (int b = 0; b < MINI_BOX_SIZE; b++)
+                    for (unsigned int hit = targets[b] & cp->digits[num][b]; hit != 0; hit &= hit - 1)
+                    {
+                        planesEliminate(cp, b * BAND_CELLS + __builtin_ctz(hit), num);
+                        eliminated++;
+                    }
+                if (path != NULL && eliminated > before)
+                    pathAdd(path, pathStep(STEP_FISH, PATH_NO_CELL, num, base, members[f]));
+            }
+        }
+    }
+    return eliminated;
+}
+
+// Time one pass of every technique on minimal puzzles where singles get stuck
+void benchmarkTechniques(int count)
+{
+    static const char *names[] = {"naked pairs", "naked triples", "naked quads", "hidden pairs", "hidden triples",
+                                  "hidden quads", "X-Wing", "Swordfish", "Jellyfish"};
+    enum { TECHNIQUES = 9, ROUNDS = 20 };
+    struct candidate_planes *stuck = malloc(count * sizeof(*stuck)), work;
+    long long elapsed[TECHNIQUES] = {0}, useful[TECHNIQUES] = {0};
+    int total = 0, tries = 0;
+
+    if (stuck == NULL)
+        return;
+
+    // minimal puzzles that singles alone cannot finish
+    seedRandom((unsigned int)time(NULL));
+    while (total < count && tries++ < count * 10)
+    {
+        resetBoard();
+        board.emptyCells = 0;
+        fillValues();
+        minimizePuzzle(board.solved);
+        planesInit(&stuck[total], board.solved);
+        planesSingles(&stuck[total]);
+        if (stuck[total].left > 0)
+            total++;
+    }
+    if (total == 0)
+    {
+        printf("No stuck puzzles found\n");
+        free(stuck);
+        return;
+    }
+
+    for (int t = 0; t < TECHNIQUES; t++)
+    {
+        int size = t % 3 + 2;
+        for (int k = 0; k < total; k++)
+        {
+            int eliminated = 0;
+            long long start = nowNanoseconds();
+            for (int r = 0; r < ROUNDS; r++)
+            {
+                work = stuck[k];
+                eliminated = t < 3 ? nakedSubsets(&work, size, NULL) : t < 6 ? hiddenSubsets(&work, size, NULL)
+                                                                             : fishPatterns(&work, size, NULL);
+            }
+            elapsed[t] += nowNanoseconds() - start;
+            useful[t] += eliminated > 0;
+        }
+    }
+
+    long long left = 0;
+    for (int k = 0; k < total; k++)
+        left += stuck[k].left;
+    printf("%d puzzles stuck after singles, %.1f empty cells on average\n", total, (double)left / total);
+    for (int t = 0; t < TECHNIQUES; t++)
+        printf("%-15s %7.1f ns per pass, eliminates in %5.1f%% of the puzzles\n", names[t],
+               (double)elapsed[t] / total / ROUNDS, 100.0 * useful[t] / total);
+    free(stuck);
+}
+
+
+/* =========== Solve Path =========== */
+
+// A puzzle can carry the whole logical solve path, recorded once when it is generated: the
+// singles in the order a player would find them, and the subset and fish eliminations when
+// singles run out. Every step is one 32 bit word,
+//   bits 0-6    cell that is placed, PATH_NO_CELL for an elimination
+//   bits 7-10   digit placed, or the digit of a fish
+//   bits 11-14  technique, one of solve_technique
+//   bits 15-19  unit of a hidden single or subset, 0 for rows or 1 for columns as fish base
+//   bits 20-28  members: cells of a naked subset, digits - 1 of a hidden one, lines of a fish
+// so a hint or an explanation is an index into the path instead of a solver run.
+
+// Pack a solve path step
+unsigned int pathStep(int technique, int cell, int num, int unit, int members)
+{
+    return (unsigned int)cell | (unsigned int)num << 7 | (unsigned int)technique << 11 | (unsigned int)unit << 15 |
+           (unsigned int)members << 20;
+}
+
+// Name of a solve technique
+const char *techniqueName(int technique)
+{
+    static const char *names[STEP_TECHNIQUES] = {"naked-single", "hidden-single", "naked-subset", "hidden-subset",
+                                                 "fish", "guess"};
+    return technique >= 0 && technique < STEP_TECHNIQUES ? names[technique] : "unknown";
+}
+
+// Record the logical solve path of a puzzle with its solution
+// returns the number of guesses, 0 when the techniques solve the whole puzzle
+int solvePath(const int grid[N][N], const int solution[N][N], struct solve_path *path)
+{
+    struct candidate_planes cp;
+    int guesses = 0;
+
+    planesInit(&cp, grid);
+    path->count = 0;
+    path->cursor = 0;
+    memset(path->stepOfCell, 255, sizeof(path->stepOfCell));
+
+    while (cp.left > 0 && path->count < SOLVE_PATH_STEPS)
+    {
+        int cell = -1, num = 0, technique = STEP_NAKED_SINGLE, unit = 0;
+
+        // the easiest single there is
+        for (int c = 0; c < N * N && cell < 0; c++)
+        {
+            if (cp.cells[c] != 0 && (cp.cells[c] & (cp.cells[c] - 1)) == 0)
+            {
+                cell = c;
+                num = __builtin_ctz(cp.cells[c]);
+            }
+        }
+        for (int u = 0; u < UNITS && cell < 0; u++)
+        {
+            for (int d = 1; d <= N && cell < 0; d++)
+            {
+                unsigned int where = cp.positions[u][d];
+                if (where != 0 && (where & (where - 1)) == 0)
+                {
+                    cell = unitCells[u][__builtin_ctz(where)];
+                    num = d;
+                    technique = STEP_HIDDEN_SINGLE;
+                    unit = u;
+                }
+            }
+        }
+        if (cell >= 0)
+        {
+            pathAdd(path, pathStep(technique, cell, num, unit, 0));
+            planesPlace(&cp, cell, num);
+            continue;
+        }
+
+        // no single: the smallest pattern that eliminates something
+        bool eliminated = false;
+        for (int size = 2; size <= 4 && !eliminated; size++)
+            eliminated = nakedSubsets(&cp, size, path) > 0 || hiddenSubsets(&cp, size, path) > 0 ||
+                         fishPatterns(&cp, size, path) > 0;
+        if (eliminated)
+            continue;
+
+        // stuck: take the digit of the cell with the fewest candidates from the solution
+        int fewest = N + 1;
+        for (int c = 0; c < N * N; c++)
+        {
+            int open = __builtin_popcount(cp.cells[c]);
+            if (cp.cells[c] != 0 && open < fewest)
+            {
+                fewest = open;
+                cell = c;
+            }
+        }
+        pathAdd(path, pathStep(STEP_GUESS, cell, solution[cell / N][cell % N], 0, 0));
+        planesPlace(&cp, cell, solution[cell / N][cell % N]);
+        guesses++;
+    }
+    return guesses;
+}
+
+// Step of the next hint: the first placing step whose cell is still empty, -1 if none
+// the cursor only moves forward, so hints over a whole game cost O(1) each
+int pathNextHint(struct solve_path *path, const int grid[N][N])
+{
+    while (path->cursor < path->count)
+    {
+        int cell = path->steps[path->cursor] & PATH_NO_CELL;
+        if (cell != PATH_NO_CELL && grid[cell / N][cell % N] == 0)
+            return path->cursor;
+        path->cursor++;
+    }
+    return -1;
+}
+
+// Write a path as 4 little endian bytes per step, returns the number of bytes
+int pathEncode(const struct solve_path *path, unsigned char *out)
+{
+    for (int k = 0; k < path->count; k++)
+        for (int b = 0; b < 4; b++)
+            out[4 * k + b] = (unsigned char)(path->steps[k] >> (8 * b));
+    return 4 * path->count;
+}
+
+// Read a path written by pathEncode(), false if the bytes are not a path
+bool pathDecode(const unsigned char *in, int length, struct solve_path *path)
+{
+    if (length % 4 != 0 || length / 4 > SOLVE_PATH_STEPS)
+        return false;
+    path->count = 0;
+    path->cursor = 0;
+    memset(path->stepOfCell, 255, sizeof(path->stepOfCell));
+    for (int k = 0; k < length / 4; k++)
+    {
+        unsigned int step = in[4 * k] | in[4 * k + 1] << 8 | in[4 * k + 2] << 16 | (unsigned int)in[4 * k + 3] << 24;
+        int cell = step & PATH_NO_CELL;
+        if ((cell != PATH_NO_CELL && cell >= N * N) || ((step >> 11) & 15) >= STEP_TECHNIQUES)
+            return false;
+        pathAdd(path, step);
+    }
+    return true;
+}
+
+// Compare hints looked up in the path with solving the board again for every hint
+void benchmarkPath(int count)
+{
+    long long recordTime = 0, lookupTime = 0, solveTime = 0, steps = 0, hints = 0, guesses = 0;
+    struct solve_path path;
+    int solution[N][N];
+
+    seedRandom((unsigned int)time(NULL));
+    for (int k = 0; k < count; k++)
+    {
+        do
+        {
+            resetBoard();
+            board.emptyCells = HARD_LVL;
+            fillValues();
+        } while (countSolutions(board.unsolved, 2) != 1); // a guess is certain without a unique solution
+
+        long long start = nowNanoseconds();
+        guesses += solvePath(board.unsolved, board.solved, &path) > 0;
+        recordTime += nowNanoseconds() - start;
+        steps += path.count;
+
+        // play the game out by taking every hint, once from the path and once by solving
+        int grid[N][N];
+        memcpy(grid, board.unsolved, sizeof(grid));
+        start = nowNanoseconds();
+        for (int r; (r = pathNextHint(&path, grid)) >= 0; hints++)
+        {
+            int cell = path.steps[r] & PATH_NO_CELL;
+            grid[cell / N][cell % N] = board.solved[cell / N][cell % N];
+        }
+        lookupTime += nowNanoseconds() - start;
+
+        memcpy(grid, board.unsolved, sizeof(grid));
+        start = nowNanoseconds();
+        for (int cell = 0; cell < N * N; cell++)
+        {
+            if (grid[cell / N][cell % N] != 0)
+                continue;
+            bitboardSolve(grid, solution, 1);
+            grid[cell / N][cell % N] = solution[cell / N][cell % N];
+        }
+        solveTime += nowNanoseconds() - start;
+    }
+
+    printf("%d unique puzzles, %.1f steps per path, %lld needed a guess\n", count, (double)steps / count, guesses);
+    printf("Recording a path: %.1f us per puzzle\n", recordTime / 1000.0 / count);
+    printf("Hint from the path: %.1f ns per hint\n", (double)lookupTime / (hints > 0 ? hints : 1));
+    printf("Hint by solving: %.1f ns per hint\n", (double)solveTime / (hints > 0 ? hints : 1));
+}
+
+
+/* =========== Dead End Check =========== */
+
+// In free entry a player can put any digit the peers leave open, and a wrong one usually
+// makes the puzzle unsolvable long before the board runs out of candidates. After every
+// move the check copies the candidate planes the move already updated and places singles
+// on the copy, up to a budget. A cell without candidates or a digit without a place in a
+// unit proves a dead end. Propagation cannot prove every dead end, one that only a search
+// would find is reported once the board gets closer to it.
+
+// Look for a contradiction with at most budget singles placed, true if the board is dead
+bool planesDeadEnd(const struct candidate_planes *cp, int budget)
+{
+    struct candidate_planes work = *cp;
+    bool placed = true;
+
+    while (placed)
+    {
+        placed = false;
+        for (int u = 0; u < UNITS; u++)
+        {
+            for (int num = 1; num <= N; num++)
+            {
+                unsigned int where = work.positions[u][num];
+                if (where == 0 && !(work.placed[u] & (1 << num)))
+                    return true; // the digit has no place left in the unit
+                if (where != 0 && (where & (where - 1)) == 0 && budget > 0)
+                {
+                    planesPlace(&work, unitCells[u][__builtin_ctz(where)], num);
+                    budget--;
+                    placed = true;
+                }
+            }
+        }
+        for (int cell = 0; cell < N * N; cell++)
+        {
+            unsigned int mask = work.cells[cell];
+            if (mask == 0 && work.value[cell] == 0)
+                return true; // the cell has no candidate left
+            if (mask != 0 && (mask & (mask - 1)) == 0 && budget > 0)
+            {
+                planesPlace(&work, cell, __builtin_ctz(mask));
+                budget--;
+                placed = true;
+            }
+        }
+    }
+    return false;
+}
+
+// Play free entry games with random legal digits and measure the dead end check
+// every move is compared with a full solve, to see how soon the check finds a dead end
+void benchmarkDeadEnd(int count)
+{
+    struct sudoku_board b = {0};
+    struct game_state game = {0};
+    long long checks = 0, checkTime = 0, dead = 0, found = 0, late = 0, falseAlarms = 0;
+
+    if (!gameFreeEntry(&b, &game, true))
+        return;
+    for (int k = 0; k < count; k++)
+    {
+        newGame(&b, &game, HARD_LVL, (unsigned int)time(NULL) + k);
+        bool wasDead = false, reported = false;
+        while (b.emptyCells > 0)
+        {
+            // a random empty cell and a random digit its peers allow
+            int cell = 0, skip = randomGenerator(b.emptyCells);
+            for (; cell < N * N; cell++)
+                if (b.unsolved[cell / N][cell % N] == 0 && --skip == 0)
+                    break;
+            unsigned int open = game.planes->cells[cell];
+            if (open == 0)
+                break; // nothing fits, the game is over
+            int num = 0;
+            for (int pick = randomGenerator(__builtin_popcount(open)); pick > 0; open &= open - 1)
+                if (--pick == 0)
+                    num = __builtin_ctz(open);
+
+            long long start = nowNanoseconds();
+            int result = applyMove(&b, &game, cell / N, cell % N, num);
+            checkTime += nowNanoseconds() - start;
+            checks++;
+
+            // the truth from a full solve of the board
+            bool isDead = bitboardSolve(b.unsolved, NULL, 1) == 0;
+            if (isDead && !wasDead)
+                dead++;
+            if (result == MOVE_DEAD_END && !isDead)
+                falseAlarms++;
+            if (result == MOVE_DEAD_END && !reported)
+            {
+                reported = true;
+                if (isDead && !wasDead)
+                    found++; // found on the very move that made the board dead
+                else
+                    late++;
+            }
+            wasDead = isDead;
+            if (reported)
+                break;
+        }
+    }
+
+    printf("%d free entry games, %lld moves, %lld reached a dead end\n", count, checks, dead);
+    printf("Move with the dead end check: %.0f ns on average\n", (double)checkTime / (checks > 0 ? checks : 1));
+    printf("Dead ends reported on the move that made them: %lld, on a later move: %lld, false alarms: %lld\n",
+           found, late, falseAlarms);
+    gameFree(&game);
+}
+
+
+/* =========== Player Stats =========== */
+
+// Stats of every player live in a directory with two files. Every finished game is appended
+// to stats.log as a fixed size record, one write() call that does not wait for the disk.
+// stats.index holds the stats of all players sorted by player id and is mapped into memory,
+// so a lookup is a binary search. Players with games in the log are kept merged in a hash
+// table in memory, filled by replaying the log on open. When the log reaches
+// STATS_COMPACT_RECORDS, the table is merged with the index into a new file that replaces the
+// old one by rename() and the log starts over. Both files carry a generation, so a log that
+// was merged before a crash is not replayed again.
+//
+// A store belongs to one process at a time: the table and the mapped index are private to
+// the process, and its compaction truncates the log and replaces the index under any other.
+// statsOpen() takes an exclusive flock() on stats.log and fails with errno EWOULDBLOCK while
+// another process holds it, so games of many players go through one process.
+
+// Id of a player name, FNV-1a, never 0 because 0 marks a free slot of the table
+unsigned long long statsPlayerId(const char *name)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (; *name != '\0'; name++)
+        hash = (hash ^ (unsigned char)*name) * 1099511628211ULL;
+    return hash != 0 ? hash : 1;
+}
+
+// Stats level of a number of empty cells
+int statsLevel(int difficulty)
+{
+    if (difficulty <= EASY_LVL)
+        return 0;
+    return difficulty <= MEDIUM_LVL ? 1 : 2;
+}
+
+// entry of a player in the index, NULL if the player is not in it
+static const struct player_stats *statsIndexFind(const struct stats_store *store, unsigned long long player)
+{
+    unsigned long long low = 0, high = store->indexCount;
+    while (low < high)
+    {
+        unsigned long long middle = (low + high) / 2;
+        if (store->index[middle].player < player)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low < store->indexCount && store->index[low].player == player ? &store->index[low] : NULL;
+}
+
+// slot of a player in the table of the log, an empty slot if the player is not in it
+static struct player_stats *statsDeltaSlot(const struct stats_store *store, unsigned long long player)
+{
+    unsigned long long slot = (player * 0x9E3779B97F4A7C15ULL) >> 20 & store->deltaMask;
+    while (store->delta[slot].player != 0 && store->delta[slot].player != player)
+        slot = (slot + 1) & store->deltaMask;
+    return &store->delta[slot];
+}
+
+// double the table of the log
+static bool statsDeltaGrow(struct stats_store *store)
+{
+    struct stats_store grown = *store;
+    grown.deltaMask = store->delta != NULL ? store->deltaMask * 2 + 1 : 1023;
+    grown.delta = calloc(grown.deltaMask + 1, sizeof(struct player_stats));
+    if (grown.delta == NULL)
+        return false;
+    for (unsigned long long slot = 0; store->delta != NULL && slot <= store->deltaMask; slot++)
+        if (store->delta[slot].player != 0)
+            *statsDeltaSlot(&grown, store->delta[slot].player) = store->delta[slot];
+    free(store->delta);
+    store->delta = grown.delta;
+    store->deltaMask = grown.deltaMask;
+    return true;
+}
+
+// add a game to the stats of its player in the table of the log
+static bool statsApply(struct stats_store *store, const struct stats_record *record)
+{
+    if ((store->deltaCount + 1) * 2 > store->deltaMask + 1 && !statsDeltaGrow(store))
+        return false;
+    struct player_stats *stats = statsDeltaSlot(store, record->player);
+    if (stats->player == 0)
+    {
+        // first game since the last compaction, start from the index
+        const struct player_stats *old = statsIndexFind(store, record->player);
+        if (old != NULL)
+            *stats = *old;
+        else
+        {
+            memset(stats, 0, sizeof(*stats));
+            stats->player = record->player;
+            stats->first = record->when;
+        }
+        store->deltaCount++;
+    }
+
+    int level = record->level < STATS_LEVELS ? record->level : STATS_LEVELS - 1;
+    stats->games++;
+    stats->attempts += record->attempts;
+    stats->seconds += record->seconds;
+    stats->last = record->when;
+    if (record->solved)
+    {
+        stats->solved[level]++;
+        if (stats->best[level] == 0 || record->seconds < stats->best[level])
+            stats->best[level] = record->seconds;
+        if (++stats->streak > stats->bestStreak)
+            stats->bestStreak = stats->streak;
+    }
+    else
+        stats->streak = 0;
+    store->logRecords++;
+    return true;
+}
+
+// map stats.index, a missing index is an empty one
+static bool statsMapIndex(struct stats_store *store)
+{
+    char path[4096];
+    struct stat info;
+    snprintf(path, sizeof(path), "%s/stats.index", store->dir);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return true;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(struct stats_header))
+    {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const struct stats_header *header = map;
+    if (memcmp(header->magic, "SUDSTATI", 8) != 0 ||
+        sizeof(*header) + header->count * sizeof(struct player_stats) > (size_t)info.st_size)
+    {
+        munmap(map, (size_t)info.st_size);
+        return false;
+    }
+    madvise(map, (size_t)info.st_size, MADV_RANDOM); // lookups touch single pages
+    store->map = map;
+    store->mapBytes = (size_t)info.st_size;
+    store->index = (const struct player_stats *)(header + 1);
+    store->indexCount = header->count;
+    store->generation = header->generation;
+    return true;
+}
+
+// empty the log and mark it with the generation of the index
+static bool statsResetLog(struct stats_store *store)
+{
+    struct stats_header header = {.magic = "SUDSTATL", .generation = store->generation};
+    store->logRecords = 0;
+    store->compactAt = STATS_COMPACT_RECORDS;
+    return ftruncate(store->log, 0) == 0 && write(store->log, &header, sizeof(header)) == (ssize_t)sizeof(header);
+}
+
+// Open or create the stats store in a directory, replays the games in the log
+// fails with errno EWOULDBLOCK if another process has the store open
+bool statsOpen(struct stats_store *store, const char *dir)
+{
+    char path[4096];
+    memset(store, 0, sizeof(*store));
+    store->log = -1;
+    store->compactAt = STATS_COMPACT_RECORDS;
+    mkdir(dir, 0755); // fails harmlessly if it exists
+    store->dir = strdup(dir);
+    snprintf(path, sizeof(path), "%s/stats.log", dir);
+    if (store->dir == NULL || (store->log = open(path, O_RDWR | O_CREAT | O_APPEND, 0644)) < 0)
+    {
+        statsClose(store);
+        return false;
+    }
+    // the lock comes before the index is mapped, so no other process compacts in between
+    if (flock(store->log, LOCK_EX | LOCK_NB) != 0)
+    {
+        int error = errno;
+        statsClose(store);
+        errno = error;
+        return false;
+    }
+    if (!statsMapIndex(store) || !statsDeltaGrow(store))
+    {
+        statsClose(store);
+        return false;
+    }
+
+    struct stats_header header;
+    if (read(store->log, &header, sizeof(header)) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, "SUDSTATL", 8) != 0 || header.generation < store->generation)
+    {
+        // a new log, or one that was merged before a crash
+        if (statsResetLog(store))
+            return true;
+        statsClose(store);
+        return false;
+    }
+
+    // replay the games, a torn record at the end is cut off
+    struct stats_record records[1024];
+    ssize_t length;
+    off_t whole = sizeof(header);
+    while ((length = read(store->log, records, sizeof(records))) > 0)
+    {
+        int count = (int)(length / (ssize_t)sizeof(records[0]));
+        for (int r = 0; r < count; r++)
+            if (!statsApply(store, &records[r]))
+            {
+                statsClose(store);
+                return false;
+            }
+        whole += (off_t)count * (off_t)sizeof(records[0]);
+        if (length % (ssize_t)sizeof(records[0]) != 0)
+            break;
+    }
+    if (ftruncate(store->log, whole) != 0)
+    {
+        statsClose(store);
+        return false;
+    }
+    return true;
+}
+
+// Append a finished game to the log and to the stats of the player, compacts when the log is full
+// the game is kept once it is in the log, a failed compaction is tried again later
+bool statsRecord(struct stats_store *store, const struct stats_record *record)
+{
+    if (record->player == 0 || write(store->log, record, sizeof(*record)) != (ssize_t)sizeof(*record))
+        return false;
+    if (!statsApply(store, record))
+        return false;
+    if (store->logRecords >= store->compactAt && !statsCompact(store))
+        store->compactAt = store->logRecords + STATS_COMPACT_RECORDS / 8;
+    return true;
+}
+
+// Stats of a player, false if the player has no games
+bool statsLookup(const struct stats_store *store, unsigned long long player, struct player_stats *out)
+{
+    const struct player_stats *stats = statsDeltaSlot(store, player);
+    if (stats->player == 0)
+        stats = statsIndexFind(store, player);
+    if (stats == NULL)
+        return false;
+    *out = *stats;
+    return true;
+}
+
+// order of the table entries by player
+static int statsComparePlayers(const void *a, const void *b)
+{
+    unsigned long long x = ((const struct player_stats *)a)->player;
+    unsigned long long y = ((const struct player_stats *)b)->player;
+    return (x > y) - (x < y);
+}
+
+// Merge the table of the log with the index into a new index and start the log over
+bool statsCompact(struct stats_store *store)
+{
+    char path[4096], temporary[4096];
+    snprintf(path, sizeof(path), "%s/stats.index", store->dir);
+    snprintf(temporary, sizeof(temporary), "%s/stats.index.new", store->dir);
+
+    // the players of the log in order, in a copy so the table keeps serving if the merge fails
+    unsigned long long changed = 0;
+    struct player_stats *sorted = malloc((store->deltaCount + 1) * sizeof(struct player_stats));
+    if (sorted == NULL)
+        return false;
+    for (unsigned long long slot = 0; slot <= store->deltaMask; slot++)
+        if (store->delta[slot].player != 0)
+            sorted[changed++] = store->delta[slot];
+    qsort(sorted, changed, sizeof(struct player_stats), statsComparePlayers);
+
+    FILE *file = fopen(temporary, "w");
+    if (file == NULL)
+    {
+        free(sorted);
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    struct stats_header header = {.magic = "SUDSTATI", .generation = store->generation + 1};
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    // merge walk, the table holds the newer stats of a player in both
+    unsigned long long i = 0, d = 0;
+    while (ok && (i < store->indexCount || d < changed))
+    {
+        const struct player_stats *next;
+        if (d == changed || (i < store->indexCount && store->index[i].player < sorted[d].player))
+            next = &store->index[i++];
+        else
+        {
+            if (i < store->indexCount && store->index[i].player == sorted[d].player)
+                i++;
+            next = &sorted[d++];
+        }
+        ok = fwrite(next, sizeof(*next), 1, file) == 1;
+        header.count++;
+    }
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = fflush(file) == 0 && ok && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok && rename(temporary, path) == 0;
+    free(sorted);
+    if (!ok)
+    {
+        unlink(temporary);
+        return false; // the old index, the table and the log still hold every game
+    }
+
+    // the games of the log are in the new index now
+    memset(store->delta, 0, (store->deltaMask + 1) * sizeof(struct player_stats));
+    store->deltaCount = 0;
+    if (store->map != NULL)
+        munmap(store->map, store->mapBytes);
+    store->map = NULL;
+    store->indexCount = 0;
+    return statsMapIndex(store) && statsResetLog(store);
+}
+
+// Unmap and close the stats store
+void statsClose(struct stats_store *store)
+{
+    if (store->log >= 0)
+        close(store->log);
+    if (store->map != NULL)
+        munmap(store->map, store->mapBytes);
+    free(store->delta);
+    free(store->dir);
+    memset(store, 0, sizeof(*store));
+    store->log = -1;
+}
+
+// print a time in seconds as h:mm:ss or m:ss
+static void statsPrintTime(unsigned int seconds)
+{
+    if (seconds >= 3600)
+        printf("%u:%02u:%02u", seconds / 3600, seconds / 60 % 60, seconds % 60);
+    else
+        printf("%u:%02u", seconds / 60, seconds % 60);
+}
+
+// Print the stats of a player, or the size of the store if no player is given
+int runStats(int argc, char *argv[])
+{
+    static const char *levels[STATS_LEVELS] = {"Easy", "Medium", "Hard"};
+    struct stats_store store;
+    const char *name = argc > 3 && strchr(argv[3], '=') == NULL ? argv[3] : NULL;
+
+    if (!statsOpen(&store, argv[2]))
+    {
+        printf("Could not open the stats in %s%s\n", argv[2],
+               errno == EWOULDBLOCK ? ", another process is using them" : "");
+        return 1;
+    }
+    if (optionNumber(argc, argv, "compact", 0) != 0 && !statsCompact(&store))
+        printf("Compaction failed\n");
+    if (name == NULL)
+    {
+        printf("%llu players in the index, %llu games of %llu players in the log, generation %llu\n",
+               store.indexCount, store.logRecords, store.deltaCount, store.generation);
+        statsClose(&store);
+        return 0;
+    }
+
+    struct player_stats stats;
+    if (!statsLookup(&store, statsPlayerId(name), &stats))
+    {
+        printf("No games of %s yet\n", name);
+        statsClose(&store);
+        return 1;
+    }
+    unsigned int solved = stats.solved[0] + stats.solved[1] + stats.solved[2];
+    printf("%s: %u games, %u solved, streak %u (best %u)\n", name, stats.games, solved, stats.streak, stats.bestStreak);
+    for (int level = 0; level < STATS_LEVELS; level++)
+    {
+        printf("%s: %u solved", levels[level], stats.solved[level]);
+        if (stats.best[level] != 0)
+        {
+            printf(", best ");
+            statsPrintTime(stats.best[level]);
+        }
+        printf("\n");
+    }
+    printf("%u values entered, %.1f per game, time played ", stats.attempts, (double)stats.attempts / stats.games);
+    statsPrintTime(stats.seconds);
+    printf("\n");
+    statsClose(&store);
+    return 0;
+}
+
+// Write games of count players into a new store, then look players up and reopen it
+void benchmarkStats(int count)
+{
+    char dir[] = "/tmp/sudoku-stats-XXXXXX";
+    struct stats_store store;
+    struct latency_histogram writes = {0}, lookups = {0};
+
+    if (mkdtemp(dir) == NULL || !statsOpen(&store, dir))
+    {
+        printf("Could not create a stats store\n");
+        return;
+    }
+    seedRandom(1);
+
+    // twice as many games as players, so compactions merge players that are in the index
+    long long games = 2LL * count, compactions = 0, start = nowNanoseconds();
+    for (long long g = 0; g < games; g++)
+    {
+        char name[32];
+        sprintf(name, "player%d", randomGenerator(count));
+        struct stats_record record = {.player = statsPlayerId(name), .when = (unsigned int)time(NULL),
+                                      .seconds = 60 + randomGenerator(1200), .attempts = 13 + randomGenerator(60),
+                                      .level = randomGenerator(STATS_LEVELS) - 1, .solved = randomGenerator(10) > 2};
+        unsigned long long generation = store.generation;
+        long long before = nowNanoseconds();
+        if (!statsRecord(&store, &record))
+        {
+            printf("Write failed\n");
+            break;
+        }
+        latencyRecord(&writes, nowNanoseconds() - before);
+        compactions += store.generation != generation;
+    }
+    double writeSeconds = (nowNanoseconds() - start) / 1e9;
+
+    long long found = 0;
+    for (int k = 0; k < 1000000; k++)
+    {
+        char name[32];
+        struct player_stats stats;
+        sprintf(name, "player%d", randomGenerator(count));
+        long long before = nowNanoseconds();
+        found += statsLookup(&store, statsPlayerId(name), &stats);
+        latencyRecord(&lookups, nowNanoseconds() - before);
+    }
+    unsigned long long inLog = store.logRecords;
+    statsClose(&store);
+
+    start = nowNanoseconds();
+    bool reopened = statsOpen(&store, dir);
+    double reopen = (nowNanoseconds() - start) / 1e6;
+
+    printf("%lld games of %d players in %.2f s, %lld compactions, %llu players in the index, %llu games in the log\n",
+           games, count, writeSeconds, compactions, store.indexCount, inLog);
+    printf("Lookups: %lld of 1000000 found, reopen with log replay %s in %.1f ms\n", found,
+           reopened ? "done" : "FAILED", reopen);
+    latencyPrint("Write", &writes);
+    latencyPrint("Lookup", &lookups);
+
+    char path[sizeof(dir) + 32];
+    statsClose(&store);
+    sprintf(path, "%s/stats.log", dir);
+    unlink(path);
+    sprintf(path, "%s/stats.index", dir);
+    unlink(path);
+    rmdir(dir);
+}
+
+
+/* =========== Generation Farm =========== */
+
+// The farm spreads the generation of a bank over processes, and over hosts with TCP. The
+// coordinator cuts the bank into leases of consecutive puzzles and hands one lease at a
+// time to every worker that connects. A worker generates the puzzles of its lease with the
+// fillValues() pipeline, grades them and sends them back in 24 bytes each: the rank of the
+// solution and a clue mask. A lease goes back to the pool when its worker disconnects or
+// when it is not done before the timeout, and the first result of a lease wins. Puzzle k
+// uses seed + k like --generate, so the bank does not depend on which worker made what.
+// Options of --farm coordinator (name=value):
+//   listen   unix:/path or address:port to wait for workers on (default 127.0.0.1:9200)
+//   count    number of puzzles (default 100000)
+//   lease    puzzles per lease (default 256)
+//   level    number of empty cells (default HARD_LVL)
+//   seed     seed of the first puzzle (default: current time)
+//   timeout  seconds before a lease is handed to another worker (default 10)
+//   workers  local worker processes to start, 0 to only wait for others (default 0)
+//   kill     1 to kill the first local worker half way, to see its lease handed on
+//   out      file to write the puzzles to, one "puzzle solution" line each
+// Options of --farm worker: connect, the address of the coordinator.
+
+// Generate and grade the puzzles of a lease
+void farmGenerate(const struct farm_message *lease, struct farm_puzzle *out)
+{
+    struct grade_report report;
+    for (unsigned int k = 0; k < lease->count; k++)
+    {
+        seedRandom(lease->seed + (unsigned int)(lease->first + k));
+        resetBoard();
+        board.emptyCells = (int)lease->difficulty;
+        fillValues();
+        memset(&out[k], 0, sizeof(out[k]));
+        rankSolution(board.solved, out[k].rank);
+        for (int c = 0; c < N * N; c++)
+            if (board.unsolved[c / N][c % N] != 0)
+                out[k].clues[c / 8] |= (unsigned char)(1 << (c % 8));
+        out[k].band = (unsigned char)gradePuzzle((const int (*)[N])board.unsolved, &report);
+    }
+}
+
+// send all bytes of a buffer, false if the connection is gone
+static bool farmSend(int fd, const void *data, size_t length)
+{
+    const char *p = data;
+    while (length > 0)
+    {
+        ssize_t sent = send(fd, p, length, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        p += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+// receive exactly length bytes, false if the connection is gone or too slow
+static bool farmReceive(int fd, void *data, size_t length)
+{
+    return recv(fd, data, length, MSG_WAITALL) == (ssize_t)length;
+}
+
+// connect to unix:/path or address:port, -1 if it fails
+static int farmConnect(const char *where)
+{
+    int fd;
+    if (strncmp(where, "unix:", 5) == 0)
+    {
+        struct sockaddr_un address = {.sun_family = AF_UNIX};
+        if (strlen(where + 5) >= sizeof(address.sun_path))
+            return -1;
+        strcpy(address.sun_path, where + 5);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0)
+            return fd;
+    }
+    else
+    {
+        char host[64];
+        const char *colon = strrchr(where, ':');
+        struct sockaddr_in address = {.sin_family = AF_INET};
+        if (colon == NULL || colon - where >= (int)sizeof(host))
+            return -1;
+        memcpy(host, where, colon - where);
+        host[colon - where] = 0;
+        address.sin_port = htons((unsigned short)atoi(colon + 1));
+        if (inet_pton(AF_INET, host, &address.sin_addr) != 1)
+            return -1;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0)
+            return fd;
+    }
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+// Connect to a farm coordinator and work on its leases until it is done
+int farmWorker(const char *where)
+{
+    int fd = -1;
+    for (int tries = 0; tries < 50 && (fd = farmConnect(where)) < 0; tries++)
+        usleep(100000); // the coordinator may still be starting
+    if (fd < 0)
+    {
+        printf("Cannot connect to the farm at %s!\n", where);
+        return 1;
+    }
+
+    struct farm_message message = {.type = FARM_HELLO};
+    struct farm_puzzle *puzzles = NULL;
+    unsigned int capacity = 0;
+    bool ok = farmSend(fd, &message, sizeof(message));
+    while (ok && farmReceive(fd, &message, sizeof(message)) && message.type == FARM_LEASE)
+    {
+        if (message.difficulty > MAX_EMPTY_CELLS)
+            break; // the generator would never finish, leave the lease to time out
+        if (message.count > capacity)
+        {
+            free(puzzles);
+            capacity = message.count;
+            puzzles = malloc(capacity * sizeof(struct farm_puzzle));
+            if (puzzles == NULL)
+                break;
+        }
+        farmGenerate(&message, puzzles);
+        message.type = FARM_RESULT;
+        ok = farmSend(fd, &message, sizeof(message)) &&
+             farmSend(fd, puzzles, message.count * sizeof(struct farm_puzzle));
+    }
+    free(puzzles);
+    close(fd);
+    return 0;
+}
+
+// hand the next open lease to an idle worker, false if the worker is gone
+static bool farmAssign(struct farm_coordinator *farm, int w)
+{
+    struct farm_worker *worker = &farm->workers[w];
+    if (farm->leasesDone == farm->leaseCount)
+    {
+        struct farm_message done = {.type = FARM_DONE};
+        return farmSend(worker->fd, &done, sizeof(done));
+    }
+
+    // leases that were never handed out first, then the ones that came back
+    int lease = farm->nextLease < farm->leaseCount ? farm->nextLease++ : -1;
+    for (int l = 0; lease < 0 && l < farm->leaseCount; l++)
+        if (!farm->leases[l].done && farm->leases[l].worker < 0)
+            lease = l;
+    if (lease < 0)
+        return true; // every open lease is held, wait for one to come back
+
+    struct farm_message message = {.type = FARM_LEASE, .lease = (unsigned int)lease,
+                                   .first = (unsigned long long)lease * farm->leaseSize,
+                                   .difficulty = farm->difficulty, .seed = farm->seed};
+    message.count = (unsigned int)(farm->count - (long long)message.first < farm->leaseSize
+                                       ? farm->count - (long long)message.first : farm->leaseSize);
+    farm->leases[lease].worker = w;
+    farm->leases[lease].deadline = nowNanoseconds() + farm->timeout;
+    worker->lease = lease;
+    return farmSend(worker->fd, &message, sizeof(message));
+}
+
+// close a worker connection, its lease goes back to the pool
+static void farmDrop(struct farm_coordinator *farm, int w)
+{
+    struct farm_worker *worker = &farm->workers[w];
+    if (worker->lease >= 0 && farm->leases[worker->lease].worker == w && !farm->leases[worker->lease].done)
+    {
+        farm->leases[worker->lease].worker = -1;
+        farm->reassigned++;
+    }
+    close(worker->fd);
+    worker->fd = -1;
+    worker->lease = -1;
+}
+
+// read one message of a worker and answer it, false if the worker has to be dropped
+static bool farmServe(struct farm_coordinator *farm, int w)
+{
+    struct farm_worker *worker = &farm->workers[w];
+    struct farm_message message;
+    if (!farmReceive(worker->fd, &message, sizeof(message)))
+        return false;
+    if (message.type == FARM_RESULT)
+    {
+        if (message.lease >= (unsigned int)farm->leaseCount ||
+            (long long)message.first != (long long)message.lease * farm->leaseSize)
+            return false; // not a lease of this bank
+        long long left = farm->count - (long long)message.first;
+        if (message.count != (left < farm->leaseSize ? left : farm->leaseSize))
+            return false; // fewer puzzles would leave zeroed records, more would overwrite the next lease
+        struct farm_lease *lease = &farm->leases[message.lease];
+        if (lease->done)
+        {
+            // a late copy of a lease that was handed on, read and drop it
+            struct farm_puzzle skip;
+            for (unsigned int k = 0; k < message.count; k++)
+                if (!farmReceive(worker->fd, &skip, sizeof(skip)))
+                    return false;
+        }
+        else
+        {
+            if (!farmReceive(worker->fd, &farm->puzzles[message.first], message.count * sizeof(struct farm_puzzle)))
+                return false;
+            lease->done = true;
+            lease->worker = -1;
+            farm->leasesDone++;
+            farm->resultBytes += message.count * sizeof(struct farm_puzzle);
+        }
+        if (worker->lease == (int)message.lease)
+            worker->lease = -1;
+    }
+    else if (message.type != FARM_HELLO)
+        return false;
+    return worker->lease >= 0 || farmAssign(farm, w);
+}
+
+// Run a farm coordinator, or a worker with --farm worker connect=...
+int runFarm(int argc, char *argv[])
+{
+    const char *where = "127.0.0.1:9200", *out = NULL;
+    for (int a = 3; a < argc; a++)
+    {
+        if (strncmp(argv[a], "listen=", 7) == 0 || strncmp(argv[a], "connect=", 8) == 0)
+            where = strchr(argv[a], '=') + 1;
+        else if (strncmp(argv[a], "out=", 4) == 0)
+            out = argv[a] + 4;
+    }
+    if (strcmp(argv[2], "worker") == 0)
+        return farmWorker(where);
+    if (strcmp(argv[2], "coordinator") != 0)
+    {
+        printf("Unknown farm role: %s\n", argv[2]);
+        return 1;
+    }
+
+    static struct farm_coordinator farm;
+    farm.count = (long long)optionNumber(argc, argv, "count", 100000);
+    farm.leaseSize = (unsigned int)optionNumber(argc, argv, "lease", 256);
+    farm.difficulty = (unsigned int)optionLevel(argc, argv, HARD_LVL); // -1 becomes too large
+    farm.seed = (unsigned int)optionNumber(argc, argv, "seed", (double)time(NULL));
+    farm.timeout = (long long)(optionNumber(argc, argv, "timeout", 10) * 1e9);
+    int local = (int)optionNumber(argc, argv, "workers", 0);
+    bool killOne = optionNumber(argc, argv, "kill", 0) != 0;
+    if (farm.count < 1 || farm.leaseSize < 1 || farm.difficulty > MAX_EMPTY_CELLS || local < 0 || local > FARM_WORKERS)
+    {
+        printf("Invalid farm options!\n");
+        return 1;
+    }
+    farm.leaseCount = (int)((farm.count + farm.leaseSize - 1) / farm.leaseSize);
+    farm.leases = calloc(farm.leaseCount, sizeof(struct farm_lease));
+    farm.puzzles = calloc(farm.count, sizeof(struct farm_puzzle));
+    int listener = serviceListen(where);
+    if (farm.leases == NULL || farm.puzzles == NULL || listener < 0)
+    {
+        printf("Cannot start the farm on %s!\n", where);
+        return 1;
+    }
+    for (int l = 0; l < farm.leaseCount; l++)
+        farm.leases[l].worker = -1;
+    for (int w = 0; w < FARM_WORKERS; w++)
+        farm.workers[w] = (struct farm_worker){.fd = -1, .lease = -1};
+
+    // local workers are separate processes, a crash in one does not take the others down
+    pid_t pids[FARM_WORKERS];
+    fflush(stdout);
+    for (int k = 0; k < local; k++)
+    {
+        pids[k] = fork();
+        if (pids[k] == 0)
+        {
+            close(listener);
+            _exit(farmWorker(where));
+        }
+        if (pids[k] < 0)
+        {
+            // only the started workers are killed and waited for, kill(-1) would hit every process
+            printf("Could only start %d of %d local workers!\n", k, local);
+            local = k;
+            break;
+        }
+    }
+
+    int loop = epoll_create1(0);
+    struct epoll_event watch = {.events = EPOLLIN, .data.u32 = FARM_WORKERS};
+    epoll_ctl(loop, EPOLL_CTL_ADD, listener, &watch);
+    long long start = nowNanoseconds();
+    int connected = 0;
+    bool killed = false;
+    struct timeval slow = {1, 0}; // a worker stuck in the middle of a message is dropped
+
+    while (farm.leasesDone < farm.leaseCount)
+    {
+        struct epoll_event events[64];
+        int count = epoll_wait(loop, events, 64, 100);
+        for (int e = 0; e < count; e++)
+        {
+            int w = (int)events[e].data.u32;
+            if (w == FARM_WORKERS)
+            {
+                int fd = accept(listener, NULL, NULL);
+                for (w = 0; w < FARM_WORKERS && farm.workers[w].fd >= 0; w++)
+                    ;
+                if (fd < 0 || w == FARM_WORKERS)
+                {
+                    if (fd >= 0)
+                        close(fd);
+                    continue;
+                }
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &slow, sizeof(slow));
+                farm.workers[w].fd = fd;
+                watch.data.u32 = (unsigned int)w;
+                epoll_ctl(loop, EPOLL_CTL_ADD, fd, &watch);
+                connected++;
+            }
+            else if (farm.workers[w].fd >= 0 && !farmServe(&farm, w))
+                farmDrop(&farm, w);
+        }
+
+        // expired leases go back to the pool, their workers may still send them
+        long long now = nowNanoseconds();
+        for (int l = 0; l < farm.leaseCount; l++)
+        {
+            if (!farm.leases[l].done && farm.leases[l].worker >= 0 && now > farm.leases[l].deadline)
+            {
+                farm.workers[farm.leases[l].worker].lease = -1;
+                farm.leases[l].worker = -1;
+                farm.reassigned++;
+            }
+        }
+        for (int w = 0; w < FARM_WORKERS; w++)
+            if (farm.workers[w].fd >= 0 && farm.workers[w].lease < 0 && !farmAssign(&farm, w))
+                farmDrop(&farm, w);
+
+        if (killOne && !killed && local > 0 && 2 * farm.leasesDone >= farm.leaseCount)
+        {
+            kill(pids[0], SIGKILL);
+            killed = true;
+        }
+    }
+    double seconds = (nowNanoseconds() - start) / 1e9;
+
+    for (int w = 0; w < FARM_WORKERS; w++)
+        if (farm.workers[w].fd >= 0)
+        {
+            farmAssign(&farm, w); // tells it to leave
+            close(farm.workers[w].fd);
+        }
+    for (int k = 0; k < local; k++)
+        waitpid(pids[k], NULL, 0);
+    close(loop);
+    close(listener);
+    if (strncmp(where, "unix:", 5) == 0)
+        unlink(where + 5);
+
+    // summary and the bank, checksum is the sum of all clues like --generate
+    long long bands[BAND_COUNT] = {0}, checksum = 0;
+    FILE *file = out != NULL ? fopen(out, "w") : NULL;
+    if (out != NULL && file == NULL)
+        printf("Cannot open %s!\n", out);
+    for (long long k = 0; k < farm.count; k++)
+    {
+        const struct farm_puzzle *puzzle = &farm.puzzles[k];
+        int solution[N][N];
+        char line[2 * N * N + 2];
+        unrankSolution(puzzle->rank, solution);
+        bands[puzzle->band < BAND_COUNT ? puzzle->band : BAND_INVALID]++;
+        for (int c = 0; c < N * N; c++)
+        {
+            int clue = puzzle->clues[c / 8] >> (c % 8) & 1 ? solution[c / N][c % N] : 0;
+            checksum += clue;
+            line[c] = (char)('0' + clue);
+            line[N * N + 1 + c] = (char)('0' + solution[c / N][c % N]);
+        }
+        line[N * N] = ' ';
+        line[2 * N * N + 1] = '\n';
+        if (file != NULL)
+            fwrite(line, 1, sizeof(line), file);
+    }
+    if (file != NULL)
+        fclose(file);
+
+    printf("%lld puzzles in %.2f s, %.0f per second, %d workers connected, %d leases, %lld handed on\n",
+           farm.count, seconds, farm.count / seconds, connected, farm.leaseCount, farm.reassigned);
+    printf("%.1f MB of results, checksum %lld, bands:", farm.resultBytes / 1e6, checksum);
+    for (int b = 0; b < BAND_COUNT; b++)
+        printf(" %s %lld", bandName(b), bands[b]);
+    printf("\n");
+    free(farm.leases);
+    free(farm.puzzles);
+    return 0;
+}
+
+
+/* =========== Performance Counters =========== */
+
+// Wall clock time does not say why an engine is slow. The benchmarks open a group of
+// counters with perf_event_open for every phase they time: cycles, instructions, branch
+// misses, L1D read misses and LLC misses, counted in user space only so that
+// perf_event_paranoid=2 is enough. Without a PMU, as in most VMs, the kernel's software
+// counters are used instead, and when perf_event_open is not allowed at all the thread CPU
+// time and page faults. A phase is counted only between perfStart() and perfStop(), so a
+// benchmark can interleave engines and still get the counts of each one. What an empty
+// interval counts is measured when the counters are opened and taken off every interval.
+
+// names of the counters of every mode, NULL where a mode has fewer
+static const char *perfNames[PERF_MODES][PERF_EVENTS] = {
+    {"cycles", "instructions", "branch misses", "L1D misses", "LLC misses"},
+    {"task clock ns", "page faults", "context switches", NULL, NULL},
+    {"CPU ns", "page faults", NULL, NULL, NULL},
+};
+
+// perf_event_open has no wrapper in glibc
+static int perfEventOpen(unsigned int type, unsigned long long config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group < 0;  // the leader starts the whole group
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// counts of the thread in PERF_CLOCK mode
+static void perfClockRead(long long values[PERF_EVENTS])
+{
+    struct timespec now;
+    struct rusage usage;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    getrusage(RUSAGE_THREAD, &usage);
+    values[0] = now.tv_sec * 1000000000LL + now.tv_nsec;
+    values[1] = usage.ru_minflt + usage.ru_majflt;
+    for (int e = 2; e < PERF_EVENTS; e++)
+        values[e] = 0; // the clock has no other counters
+}
+
+// total counts since the last reset, false for a counter that is missing
+static bool perfRead(struct perf_counters *pc, int e, double *value)
+{
+    unsigned long long counts[3]; // value, time enabled, time running
+    if (pc->mode == PERF_CLOCK)
+    {
+        *value = (double)pc->values[e];
+        return perfNames[PERF_CLOCK][e] != NULL;
+    }
+    if (pc->fds[e] < 0 || read(pc->fds[e], counts, sizeof(counts)) != (ssize_t)sizeof(counts))
+        return false;
+    // scale up when the kernel had to share the PMU with other counters
+    *value = counts[2] > 0 ? (double)counts[0] * counts[1] / counts[2] : 0.0;
+    return true;
+}
+
+// start counting over
+static void perfReset(struct perf_counters *pc)
+{
+    if (pc->mode != PERF_CLOCK)
+        ioctl(pc->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    memset(pc->values, 0, sizeof(pc->values));
+    pc->intervals = 0;
+}
+
+// measure what an empty interval counts, the enable and disable calls are not free
+static void perfCalibrate(struct perf_counters *pc)
+{
+    for (int k = 0; k < 64; k++)
+    {
+        perfStart(pc);
+        perfStop(pc);
+    }
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        double value = 0;
+        pc->overhead[e] = perfRead(pc, e, &value) ? value / 64 : 0.0;
+    }
+    perfReset(pc);
+}
+
+// Open the best counters available, returns the mode
+int perfOpen(struct perf_counters *pc)
+{
+    static const unsigned long long hardware[PERF_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+        PERF_COUNT_HW_CACHE_MISSES};
+    static const unsigned int hardwareTypes[PERF_EVENTS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE};
+    static const unsigned long long software[PERF_EVENTS] = {
+        PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CONTEXT_SWITCHES};
+
+    memset(pc, 0, sizeof(*pc));
+    for (int e = 0; e < PERF_EVENTS; e++)
+        pc->fds[e] = -1;
+
+    // a counter the CPU does not have stays -1, only the leader has to exist
+    pc->fds[0] = perfEventOpen(PERF_TYPE_HARDWARE, hardware[0], -1);
+    if (pc->fds[0] >= 0)
+    {
+        pc->mode = PERF_HARDWARE;
+        for (int e = 1; e < PERF_EVENTS; e++)
+            pc->fds[e] = perfEventOpen(hardwareTypes[e], hardware[e], pc->fds[0]);
+        perfCalibrate(pc);
+        return pc->mode;
+    }
+    pc->fds[0] = perfEventOpen(PERF_TYPE_SOFTWARE, software[0], -1);
+    if (pc->fds[0] >= 0)
+    {
+        pc->mode = PERF_SOFTWARE;
+        for (int e = 1; e < PERF_EVENTS && perfNames[PERF_SOFTWARE][e] != NULL; e++)
+            pc->fds[e] = perfEventOpen(PERF_TYPE_SOFTWARE, software[e], pc->fds[0]);
+        perfCalibrate(pc);
+        return pc->mode;
+    }
+    pc->mode = PERF_CLOCK;
+    perfCalibrate(pc);
+    return pc->mode;
+}
+
+// Count from here
+void perfStart(struct perf_counters *pc)
+{
+    pc->intervals++;
+    if (pc->mode == PERF_CLOCK)
+        perfClockRead(pc->started);
+    else
+        ioctl(pc->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+// Stop counting, the counts are kept for perfReport()
+void perfStop(struct perf_counters *pc)
+{
+    if (pc->mode != PERF_CLOCK)
+    {
+        ioctl(pc->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        return;
+    }
+    long long now[PERF_EVENTS];
+    perfClockRead(now);
+    for (int e = 0; e < PERF_EVENTS; e++)
+        pc->values[e] += now[e] - pc->started[e];
+}
+
+// Print the counts per unit and reset them
+void perfReport(struct perf_counters *pc, const char *phase, long long units, const char *unit)
+{
+    double perUnit[PERF_EVENTS] = {0};
+    bool have[PERF_EVENTS] = {false};
+
+    for (int e = 0; e < PERF_EVENTS; e++)
+    {
+        double value = 0;
+        have[e] = perfRead(pc, e, &value);
+        value -= pc->overhead[e] * pc->intervals;
+        perUnit[e] = (value > 0 ? value : 0.0) / units;
+    }
+    perfReset(pc);
+
+    printf("  %s per %s:", phase, unit);
+    for (int e = 0; e < PERF_EVENTS; e++)
+        if (have[e])
+            printf("%s %.1f %s", e > 0 ? "," : "", perUnit[e], perfNames[pc->mode][e]);
+    if (pc->mode == PERF_HARDWARE && have[1] && perUnit[0] > 0)
+        printf(", %.2f IPC", perUnit[1] / perUnit[0]);
+    if (pc->mode != PERF_HARDWARE)
+        printf(" (no hardware counters)");
+    printf("\n");
+}
+
+// Close the counters
+void perfClose(struct perf_counters *pc)
+{
+    for (int e = 0; e < PERF_EVENTS; e++)
+        if (pc->fds[e] >= 0)
+            close(pc->fds[e]);
+}
+
+// Count events in every phase of generating and solving puzzles
+// the phases run one after another over the same boards, like fillValues() runs them
+void benchmarkCounters(int count)
+{
+    enum {PHASE_DIAGONAL, PHASE_FILL, PHASE_RECURSIVE, PHASE_HOLES, PHASE_MASKS, PHASE_BITBOARD, PHASE_GRADE,
+          PHASE_VALIDATE, PHASES};
+    static const char *names[PHASES] = {"fillDiagonal()", "fillRemaining()", "fillRemainingRecursive()",
+                                        "addEmptyCells()", "countSolutionsMasks()", "bitboardSolve()",
+                                        "gradePuzzle()", "validateGrid()"};
+    struct perf_counters counters[PHASES];
+    struct sudoku_board *boards = malloc(count * sizeof(struct sudoku_board));
+    struct grade_report report;
+    int solution[N][N];
+    long long checksum = 0;
+
+    if (boards == NULL)
+        return;
+    for (int p = 0; p < PHASES; p++)
+        perfOpen(&counters[p]);
+    seedRandom((unsigned int)time(NULL));
+
+    for (int k = 0; k < count; k++)
+    {
+        resetBoard();
+        board.emptyCells = HARD_LVL;
+        perfStart(&counters[PHASE_DIAGONAL]);
+        fillDiagonal();
+        perfStop(&counters[PHASE_DIAGONAL]);
+        struct sudoku_board diagonal = board;
+
+        // the original recursion on a copy, for the engine comparison
+        perfStart(&counters[PHASE_RECURSIVE]);
+        fillRemainingRecursive(0, MINI_BOX_SIZE);
+        perfStop(&counters[PHASE_RECURSIVE]);
+        board = diagonal;
+
+        perfStart(&counters[PHASE_FILL]);
+        fillRemaining(0, MINI_BOX_SIZE);
+        perfStop(&counters[PHASE_FILL]);
+        memcpy(board.solved, board.unsolved, sizeof(board.solved));
+        perfStart(&counters[PHASE_HOLES]);
+        addEmptyCells();
+        perfStop(&counters[PHASE_HOLES]);
+        boards[k] = board;
+    }
+
+    for (int k = 0; k < count; k++)
+    {
+        perfStart(&counters[PHASE_MASKS]);
+        checksum += countSolutionsMasks(boards[k].unsolved, 2);
+        perfStop(&counters[PHASE_MASKS]);
+        perfStart(&counters[PHASE_BITBOARD]);
+        checksum += bitboardSolve(boards[k].unsolved, solution, 2);
+        perfStop(&counters[PHASE_BITBOARD]);
+        perfStart(&counters[PHASE_GRADE]);
+        checksum += gradePuzzle(boards[k].unsolved, &report);
+        perfStop(&counters[PHASE_GRADE]);
+        perfStart(&counters[PHASE_VALIDATE]);
+        checksum += validateGrid(boards[k].solved, boards[k].unsolved);
+        perfStop(&counters[PHASE_VALIDATE]);
+    }
+
+    printf("%d puzzles with %d empty cells, counters: %s (checksum %lld)\n", count, HARD_LVL,
+           counters[0].mode == PERF_HARDWARE ? "hardware" : counters[0].mode == PERF_SOFTWARE ? "software" : "clock",
+           checksum);
+    for (int p = 0; p < PHASES; p++)
+    {
+        perfReport(&counters[p], names[p], count, "puzzle");
+        perfClose(&counters[p]);
+    }
+    free(boards);
+}
+
+
+/* =========== Shared Boards =========== */
+
+// Several players can solve one board at the same time. Every cell is a 32 bit word,
+//   bits 0-3    digit in the cell, 0 while it is empty
+//   bits 4-7    digit of the solution
+//   bits 8-15   player who put the digit in, SHARED_CLUE for a clue
+//   bits 16-22  cell id, so the word of a cell is also the change a move makes
+//   bit 23      always set, a change is never 0
+// and a move is one compare and swap from the empty word to the filled one. Moves are
+// checked against the solution, so a cell goes from empty to its digit once and the word
+// needs no version against ABA. When two players race for a cell the board ends the same
+// whatever the order: the first swap gets the credit, the other player gets MOVE_FILLED and
+// the word of the winner. Every accepted move claims the next change slot of the board and
+// publishes its word there. A player reads the slots from its own cursor, and a slot that
+// is claimed but not written yet holds back the later ones for a moment. Free entry stays
+// single player, checking three units for a digit cannot be one compare and swap.
+//
+// --shared serves the boards over sockets, one thread per connected player and one line
+// per command and reply, rows and columns start from 1. Options (name=value):
+//   boards  number of boards, board k is generated from seed + k (default 1000)
+//   level   number of empty cells (default HARD_LVL)
+//   seed    seed of board 0 (default: the time)
+//   listen  where to listen: host:port or unix:/path (default 127.0.0.1:9300)
+//   seconds stop after this many seconds, 0 to run forever (default 0)
+// Commands:
+//   JOIN <board>        -> OK <player> <81 digits, 0 for empty cells>, once per connection,
+//                          the player id is free again when the connection ends
+//   MOVE <row> <col> <value> -> OK | OK SOLVED | WRONG | FILLED <value> <player|clue> | INVALID
+//   CHANGES             -> CHANGES <count> followed by <row> <col> <value> <player> of every
+//                          move since the last CHANGES, the cursor of the player
+//   BOARD               -> BOARD <81 digits>
+//   QUIT                -> BYE
+
+// Pack a shared cell word
+unsigned int sharedCellWord(int cell, int num, int solution, int player)
+{
+    return (unsigned int)num | (unsigned int)solution << 4 | (unsigned int)player << 8 | (unsigned int)cell << 16 |
+           1u << 23;
+}
+
+// Generate a game on a shared board, nobody may use the board while it is set up
+void sharedBoardInit(struct shared_board *sb, int difficulty, unsigned int seed)
+{
+    struct sudoku_board b;
+    struct game_state game = {0};
+
+    newGame(&b, &game, difficulty, seed);
+    for (int cell = 0; cell < N * N; cell++)
+    {
+        int num = b.unsolved[cell / N][cell % N];
+        atomic_init(&sb->cells[cell], sharedCellWord(cell, num, b.solved[cell / N][cell % N], num != 0 ? SHARED_CLUE : 0));
+        atomic_init(&sb->changes[cell], 0);
+    }
+    atomic_init(&sb->changeCount, 0);
+    atomic_init(&sb->players, 0);
+    sb->emptyCells = b.emptyCells;
+    sb->seed = seed;
+}
+
+// Join a shared board as a new player, false if the board is full
+// the player takes the lowest free id, so the ids of players that left are used again.
+// The cursor starts at the first change, so a late player catches up on the whole game
+bool sharedJoin(struct shared_board *sb, struct shared_player *p)
+{
+    unsigned long long players = atomic_load_explicit(&sb->players, memory_order_relaxed);
+    int id;
+    do
+    {
+        if (players == ~0ULL)
+            return false;
+        id = __builtin_ctzll(~players);
+    } while (!atomic_compare_exchange_weak_explicit(&sb->players, &players, players | 1ULL << id,
+                                                    memory_order_relaxed, memory_order_relaxed));
+
+    *p = (struct shared_player){0};
+    p->board = sb;
+    p->id = id;
+    return true;
+}
+
+// Leave a shared board, its player id can be taken again
+// the cells the player filled keep the id, a later player with the same id shares them
+void sharedLeave(struct shared_player *p)
+{
+    if (p->board == NULL)
+        return;
+    atomic_fetch_and_explicit(&p->board->players, ~(1ULL << p->id), memory_order_relaxed);
+    p->board = NULL;
+}
+
+// Put a value on a shared board if it matches the solution, like applyMove()
+int sharedMove(struct shared_player *p, int row, int col, int num)
+{
+    struct shared_board *sb = p->board;
+    if (row < 0 || row >= N || col < 0 || col >= N || num < 1 || num > N)
+        return MOVE_INVALID;
+
+    int cell = row * N + col;
+    unsigned int word = atomic_load_explicit(&sb->cells[cell], memory_order_relaxed);
+    if ((word & 0xF) != 0)
+        return MOVE_FILLED;
+    p->attempts++;
+    if ((int)(word >> 4 & 0xF) != num)
+        return MOVE_WRONG;
+
+    unsigned int filled = sharedCellWord(cell, num, num, p->id);
+    if (!atomic_compare_exchange_strong_explicit(&sb->cells[cell], &word, filled, memory_order_relaxed,
+                                                 memory_order_relaxed))
+    {
+        p->lost++; // another player put the digit in first, word holds its move
+        return MOVE_FILLED;
+    }
+
+    // publish the change, the release makes the cell visible to whoever reads it
+    int slot = atomic_fetch_add_explicit(&sb->changeCount, 1, memory_order_relaxed);
+    atomic_store_explicit(&sb->changes[slot], filled, memory_order_release);
+    p->placed++;
+    TRACE4(move, row, col, num, p->attempts); // probe: a value was put in a cell
+    return MOVE_ACCEPTED;
+}
+
+// Copy up to max changes from the cursor of a player on and move the cursor past them
+// returns the number of changes, every change is the new word of its cell
+int sharedChanges(struct shared_player *p, unsigned int *changes, int max)
+{
+    int count = 0;
+    while (count < max && p->cursor < N * N)
+    {
+        unsigned int word = atomic_load_explicit(&p->board->changes[p->cursor], memory_order_acquire);
+        if (word == 0)
+            break; // claimed but not written yet, or no more changes
+        changes[count++] = word;
+        p->cursor++;
+    }
+    return count;
+}
+
+// Digits of a shared board, for a player who joins or draws the whole board
+void sharedSnapshot(const struct shared_board *sb, int grid[N][N])
+{
+    for (int cell = 0; cell < N * N; cell++)
+        grid[cell / N][cell % N] = (int)(atomic_load_explicit(&sb->cells[cell], memory_order_acquire) & 0xF);
+}
+
+// Check if every cell of a shared board is filled
+bool sharedSolved(const struct shared_board *sb)
+{
+    return atomic_load_explicit(&sb->changeCount, memory_order_acquire) == sb->emptyCells;
+}
+
+// Run one command of a shared board player, line must not hold the line break
+// returns the length of the reply written to reply, including its line break
+int sharedCommand(struct shared_player *p, struct shared_board *boards, int count, char *line, char *reply)
+{
+    char *command = protocolWord(&line);
+    long row, col, num;
+    int length;
+
+    if (strcmp(command, "QUIT") == 0)
+        return sprintf(reply, "BYE\n");
+    if (strcmp(command, "JOIN") == 0)
+    {
+        if (p->board != NULL)
+            return sprintf(reply, "ERR joined already\n"); // one board and one player id per connection
+        if (!protocolNumber(&line, &num) || num < 0 || num >= count)
+            return sprintf(reply, "ERR no board\n");
+        if (!sharedJoin(&boards[num], p))
+            return sprintf(reply, "ERR board full\n");
+        length = sprintf(reply, "OK %d ", p->id);
+    }
+    else if (p->board == NULL)
+        return sprintf(reply, strcmp(command, "MOVE") == 0 || strcmp(command, "CHANGES") == 0 ||
+                                      strcmp(command, "BOARD") == 0 ? "ERR join a board first\n" : "ERR unknown command\n");
+    else if (strcmp(command, "MOVE") == 0)
+    {
+        if (!protocolNumber(&line, &row) || !protocolNumber(&line, &col) || !protocolNumber(&line, &num))
+            return sprintf(reply, "ERR usage MOVE <row> <col> <value>\n");
+        switch (sharedMove(p, (int)row - 1, (int)col - 1, (int)num))
+        {
+        case MOVE_ACCEPTED:
+            return sprintf(reply, sharedSolved(p->board) ? "OK SOLVED\n" : "OK\n");
+        case MOVE_WRONG:
+            return sprintf(reply, "WRONG\n");
+        case MOVE_FILLED:
+        {
+            // the cell was filled before, or another player won the race for it
+            unsigned int word = atomic_load_explicit(&p->board->cells[(row - 1) * N + col - 1], memory_order_relaxed);
+            if ((word >> 8 & 0xFF) == SHARED_CLUE)
+                return sprintf(reply, "FILLED %u clue\n", word & 0xF);
+            return sprintf(reply, "FILLED %u %u\n", word & 0xF, word >> 8 & 0xFF);
+        }
+        default:
+            return sprintf(reply, "INVALID\n");
+        }
+    }
+    else if (strcmp(command, "CHANGES") == 0)
+    {
+        unsigned int changes[N * N];
+        int got = sharedChanges(p, changes, N * N);
+        length = sprintf(reply, "CHANGES %d", got);
+        for (int k = 0; k < got; k++)
+        {
+            int cell = changes[k] >> 16 & 0x7F;
+            length += sprintf(reply + length, " %d %d %u %u", cell / N + 1, cell % N + 1, changes[k] & 0xF,
+                              changes[k] >> 8 & 0xFF);
+        }
+        reply[length] = '\n';
+        return length + 1;
+    }
+    else if (strcmp(command, "BOARD") == 0)
+        length = sprintf(reply, "BOARD ");
+    else
+        return sprintf(reply, "ERR unknown command\n");
+
+    // JOIN and BOARD end with the digits of the board
+    int grid[N][N];
+    sharedSnapshot(p->board, grid);
+    for (int cell = 0; cell < N * N; cell++)
+        reply[length++] = (char)('0' + grid[cell / N][cell % N]);
+    reply[length] = '\n';
+    return length + 1;
+}
+
+// Connection of a player of --shared
+struct shared_connection {
+    int fd;
+    struct shared_board *boards;
+    int count;
+};
+
+// thread function of a connection, runs the commands of one player until it quits or leaves
+static void *sharedConnection(void *arg)
+{
+    struct shared_connection *connection = arg;
+    struct shared_player player = {0};
+    char in[4096], out[16 * PROTOCOL_REPLY];
+    int length = 0;
+    bool quit = false;
+
+    while (!quit)
+    {
+        ssize_t got = read(connection->fd, in + length, sizeof(in) - length - 1);
+        if (got <= 0)
+            break;
+        length += (int)got;
+
+        // the replies to all complete lines of the chunk go out in one write
+        char *line = in, *end = in + length, *newline;
+        int outLength = 0;
+        while (!quit && outLength <= (int)sizeof(out) - PROTOCOL_REPLY &&
+               (newline = memchr(line, '\n', end - line)) != NULL)
+        {
+            *newline = 0;
+            if (line != newline)
+            {
+                int replyLength = sharedCommand(&player, connection->boards, connection->count, line, out + outLength);
+                quit = memcmp(out + outLength, "BYE", 3) == 0;
+                outLength += replyLength;
+            }
+            line = newline + 1;
+        }
+        length = (int)(end - line);
+        memmove(in, line, length);
+        if (length == (int)sizeof(in) - 1)
+            length = 0; // a line longer than the buffer is dropped
+        // a player that hangs up without reading must not take the server down with SIGPIPE
+        if (outLength > 0 && send(connection->fd, out, outLength, MSG_NOSIGNAL) != outLength)
+            break;
+    }
+    sharedLeave(&player); // on QUIT or when the player hangs up
+    close(connection->fd);
+    free(connection);
+    return NULL;
+}
+
+// Serve shared boards to players over sockets
+int runShared(int argc, char *argv[])
+{
+    int count = (int)optionNumber(argc, argv, "boards", 1000);
+    int difficulty = optionLevel(argc, argv, HARD_LVL);
+    unsigned int seed = (unsigned int)optionNumber(argc, argv, "seed", (double)time(NULL));
+    double seconds = optionNumber(argc, argv, "seconds", 0);
+    const char *where = "127.0.0.1:9300";
+    for (int a = 2; a < argc; a++)
+        if (strncmp(argv[a], "listen=", 7) == 0)
+            where = argv[a] + 7;
+
+    if (count < 1 || difficulty < 0 || difficulty > MAX_EMPTY_CELLS || seconds < 0)
+    {
+        printf("Invalid shared board options!\n");
+        return 1;
+    }
+    struct shared_board *boards = aligned_alloc(CACHE_LINE, count * sizeof(struct shared_board));
+    if (boards == NULL)
+        return 1;
+    for (int b = 0; b < count; b++)
+        sharedBoardInit(&boards[b], difficulty, seed + (unsigned int)b);
+    int listener = serviceListen(where);
+    if (listener < 0)
+    {
+        printf("Cannot serve shared boards on %s!\n", where);
+        free(boards);
+        return 1;
+    }
+    printf("Serving %d shared boards on %s, board k uses seed %u + k\n", count, where, seed);
+    fflush(stdout);
+
+    // accept players until the time is up, the listener wakes up every 100 ms to check
+    long long end = seconds > 0 ? nowNanoseconds() + (long long)(seconds * 1e9) : 0;
+    int loop = epoll_create1(0);
+    struct epoll_event watch = {.events = EPOLLIN};
+    watch.data.fd = listener;
+    epoll_ctl(loop, EPOLL_CTL_ADD, listener, &watch);
+    while (end == 0 || nowNanoseconds() < end)
+    {
+        struct epoll_event event;
+        if (epoll_wait(loop, &event, 1, 100) != 1)
+            continue;
+        int fd = accept(listener, NULL, NULL);
+        struct shared_connection *connection = fd >= 0 ? malloc(sizeof(*connection)) : NULL;
+        pthread_t thread;
+        if (connection == NULL)
+        {
+            if (fd >= 0)
+                close(fd);
+            continue;
+        }
+        *connection = (struct shared_connection){fd, boards, count};
+        if (pthread_create(&thread, NULL, sharedConnection, connection) != 0)
+        {
+            close(fd);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    // players still connected are cut off when the process exits, the boards stay until then
+    close(loop);
+    close(listener);
+    return 0;
+}
+
+// Work and results of one writer of the shared board benchmark, a player on every board
+struct shared_bench_thread {
+    pthread_t thread;
+    struct shared_board *boards;
+    pthread_mutex_t *locks; // lock of every board, NULL for the lock free moves
+    int boardCount;
+    unsigned int seed;      // seed of the random number generator of the thread
+    long long moves;        // values entered
+    long long filled;       // values for cells that were filled already
+    long long placed;       // values put in first
+    long long lost;         // races for a cell lost to another player
+    long long changes;      // changes read from the cursors
+};
+
+// thread function of the shared board benchmark
+static void *sharedBenchThread(void *arg)
+{
+    struct shared_bench_thread *t = arg;
+    struct shared_player *players = calloc(t->boardCount, sizeof(struct shared_player));
+    unsigned char(*views)[N * N] = malloc(t->boardCount * sizeof(*views));
+    unsigned int changes[N * N];
+    int grid[N][N], open = 0;
+
+    if (players == NULL || views == NULL)
+    {
+        free(players);
+        free(views);
+        return NULL;
+    }
+    seedRandom(t->seed);
+    for (int b = 0; b < t->boardCount; b++)
+    {
+        sharedJoin(&t->boards[b], &players[b]);
+        sharedSnapshot(&t->boards[b], grid);
+        for (int cell = 0; cell < N * N; cell++)
+            views[b][cell] = (unsigned char)grid[cell / N][cell % N];
+        open += t->boards[b].emptyCells > 0;
+    }
+
+    while (open > 0)
+    {
+        for (int b = 0; b < t->boardCount; b++)
+        {
+            struct shared_board *sb = &t->boards[b];
+            struct shared_player *p = &players[b];
+            if (p->cursor == sb->emptyCells)
+                continue; // the player has seen the whole game
+
+            // bring the view of the player up to date, like a client drawing the board
+            int got = sharedChanges(p, changes, N * N);
+            for (int k = 0; k < got; k++)
+                views[b][changes[k] >> 16 & 0x7F] = (unsigned char)(changes[k] & 0xF);
+            t->changes += got;
+            if (p->cursor == sb->emptyCells)
+            {
+                open--;
+                continue;
+            }
+
+            // a random cell that is empty in the view, mostly with the right value
+            int cell = randomGenerator(N * N) - 1, tries = 0;
+            while (views[b][cell] != 0 && tries++ < N * N)
+                cell = (cell + 1) % (N * N);
+            if (views[b][cell] != 0)
+                continue; // the last changes are still on their way
+            int num = (int)(atomic_load_explicit(&sb->cells[cell], memory_order_relaxed) >> 4 & 0xF);
+            if (randomGenerator(10) == 1)
+                num = num % N + 1; // a wrong value every tenth move
+
+            if (t->locks != NULL)
+                pthread_mutex_lock(&t->locks[b]);
+            int result = sharedMove(p, cell / N, cell % N, num);
+            if (t->locks != NULL)
+                pthread_mutex_unlock(&t->locks[b]);
+            t->moves++;
+            t->filled += result == MOVE_FILLED;
+        }
+    }
+
+    for (int b = 0; b < t->boardCount; b++)
+    {
+        t->placed += players[b].placed;
+        t->lost += players[b].lost;
+    }
+    free(players);
+    free(views);
+    return NULL;
+}
+
+// play all boards with writers players each, returns the moves per second
+static double sharedBenchRun(struct shared_board *boards, pthread_mutex_t *locks, int count, int writers,
+                             struct shared_bench_thread *total)
+{
+    struct shared_bench_thread threads[SHARED_PLAYERS];
+    long long empty = 0;
+
+    for (int b = 0; b < count; b++)
+    {
+        sharedBoardInit(&boards[b], HARD_LVL, 1000 + (unsigned int)b);
+        empty += boards[b].emptyCells;
+    }
+
+    long long start = nowNanoseconds();
+    for (int t = 0; t < writers; t++)
+    {
+        threads[t] = (struct shared_bench_thread){0};
+        threads[t].boards = boards;
+        threads[t].locks = locks;
+        threads[t].boardCount = count;
+        threads[t].seed = (unsigned int)time(NULL) + (unsigned int)t * 1000003u;
+        pthread_create(&threads[t].thread, NULL, sharedBenchThread, &threads[t]);
+    }
+    *total = (struct shared_bench_thread){0};
+    for (int t = 0; t < writers; t++)
+    {
+        pthread_join(threads[t].thread, NULL);
+        total->moves += threads[t].moves;
+        total->filled += threads[t].filled;
+        total->placed += threads[t].placed;
+        total->lost += threads[t].lost;
+        total->changes += threads[t].changes;
+    }
+    double seconds = (nowNanoseconds() - start) / 1e9;
+
+    // every cell was filled once with its digit, and every player saw every change
+    bool whole = total->placed == empty && total->changes == empty * writers;
+    for (int b = 0; b < count && whole; b++)
+    {
+        whole = sharedSolved(&boards[b]);
+        for (int cell = 0; cell < N * N; cell++)
+        {
+            unsigned int word = atomic_load_explicit(&boards[b].cells[cell], memory_order_relaxed);
+            whole = whole && (word & 0xF) == (word >> 4 & 0xF);
+        }
+    }
+    if (!whole)
+        printf("Moves were lost or applied twice!\n");
+    return total->moves / seconds;
+}
+
+// Play shared boards with 1 to 64 writers on every board, lock free and with a mutex per board
+void benchmarkShared(int count)
+{
+    static const int writers[] = {1, 4, 16, SHARED_PLAYERS};
+    struct shared_board *boards = aligned_alloc(CACHE_LINE, count * sizeof(struct shared_board));
+    pthread_mutex_t *locks = malloc(count * sizeof(pthread_mutex_t));
+    struct shared_bench_thread fast, slow;
+
+    if (boards == NULL || locks == NULL)
+    {
+        free(boards);
+        free(locks);
+        return;
+    }
+    for (int b = 0; b < count; b++)
+        pthread_mutex_init(&locks[b], NULL);
+
+    printf("%d boards with %d empty cells, every writer is a player on every board\n", count, HARD_LVL);
+    printf("%8s %18s %18s %12s %12s\n", "writers", "lock free (/s)", "mutex (/s)", "lost races", "stale views");
+    for (int w = 0; w < (int)(sizeof(writers) / sizeof(writers[0])); w++)
+    {
+        double lockFree = sharedBenchRun(boards, NULL, count, writers[w], &fast);
+        double locked = sharedBenchRun(boards, locks, count, writers[w], &slow);
+        // a stale view is a move on a cell whose change the player had not read yet
+        printf("%8d %18.0f %18.0f %12lld %12lld\n", writers[w], lockFree, locked, fast.lost, fast.filled - fast.lost);
+    }
+
+    for (int b = 0; b < count; b++)
+        pthread_mutex_destroy(&locks[b]);
+    free(boards);
+    free(locks);
+}
@@ -0,0 +1,273 @@
+/**
+ * @file sudoku-python.c
+ * @brief Python extension module with batch generate, solve, grade and validate
+ *
+ * Boards are passed as contiguous buffers of uint8, 81 bytes per board in row order and
+ * 0 for an empty cell: bytes, bytearray, array.array('B') or NumPy arrays of dtype uint8
+ * with shape (n, 81) or (n, 9, 9). Results are written into buffers or returned as one
+ * bytes object per call, never as one Python object per board. The GIL is released while a
+ * batch runs, the engine keeps its board and random state per thread, so batches on
+ * several Python threads run in parallel.
+ *
+ * Build with: python3 setup.py build_ext --inplace
+ *
+ *   import sudoku, numpy as np
+ *   puzzles = np.zeros((1000, 9, 9), np.uint8); solutions = np.zeros_like(puzzles)
+ *   sudoku.generate(puzzles, solutions, level=41, seed=7)
+ *   bands = np.frombuffer(sudoku.grade(puzzles), np.uint8)
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#define main sudokuProgramMain  // the engine comes with the program, its main() is not used
+#include "sudoku-linux.c"
+#undef main
+
+// get a buffer of whole boards, false with an exception set if it is not one
+static bool pythonBoards(PyObject *object, Py_buffer *view, bool writable, Py_ssize_t *count)
+{
+    if (PyObject_GetBuffer(object, view, PyBUF_C_CONTIGUOUS | (writable ? PyBUF_WRITABLE : 0)) != 0)
+        return false;
+    if (view->itemsize != 1 || view->len % (N * N) != 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "boards must be uint8 with 81 cells per board");
+        PyBuffer_Release(view);
+        return false;
+    }
+    *count = view->len / (N * N);
+    return true;
+}
+
+// board of a buffer as a grid of the engine
+static void pythonGrid(const unsigned char *cells, int grid[N][N])
+{
+    for (int c = 0; c < N * N; c++)
+        grid[c / N][c % N] = cells[c] <= N ? cells[c] : 0;
+}
+
+// generate(puzzles, solutions=None, level=41, seed=0) -> number of boards
+// fills the puzzles and solutions like fillValues(), board k uses seed + k like --generate
+static PyObject *pythonGenerate(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"puzzles", "solutions", "level", "seed", NULL};
+    PyObject *puzzlesObject, *solutionsObject = Py_None;
+    int level = HARD_LVL;
+    unsigned int seed = 0;
+    Py_buffer puzzles, solutions = {0};
+    Py_ssize_t count, solutionCount = 0;
+    (void)self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OiI", keywords, &puzzlesObject, &solutionsObject, &level, &seed))
+        return NULL;
+    if (level < 0 || level > MAX_EMPTY_CELLS)
+        return PyErr_Format(PyExc_ValueError, "level must be from 0 to %d empty cells", MAX_EMPTY_CELLS);
+    if (!pythonBoards(puzzlesObject, &puzzles, true, &count))
+        return NULL;
+    if (solutionsObject != Py_None && !pythonBoards(solutionsObject, &solutions, true, &solutionCount))
+    {
+        PyBuffer_Release(&puzzles);
+        return NULL;
+    }
+    if (solutionsObject != Py_None && solutionCount != count)
+    {
+        PyBuffer_Release(&puzzles);
+        PyBuffer_Release(&solutions);
+        PyErr_SetString(PyExc_ValueError, "puzzles and solutions must hold the same number of boards");
+        return NULL;
+    }
+
+    unsigned char *out = puzzles.buf, *solved = solutions.buf;
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t k = 0; k < count; k++)
+    {
+        seedRandom(seed + (unsigned int)k);
+        resetBoard();
+        board.emptyCells = level;
+        fillValues();
+        for (int c = 0; c < N * N; c++)
+        {
+            out[k * N * N + c] = (unsigned char)board.unsolved[c / N][c % N];
+            if (solved != NULL)
+                solved[k * N * N + c] = (unsigned char)board.solved[c / N][c % N];
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&puzzles);
+    if (solutionsObject != Py_None)
+        PyBuffer_Release(&solutions);
+    return PyLong_FromSsize_t(count);
+}
+
+// solve(puzzles, solutions=None) -> bytes with the number of solutions of every board
+// counted up to 2 with the bitboard engine, the first solution is written to solutions
+static PyObject *pythonSolve(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"puzzles", "solutions", NULL};
+    PyObject *puzzlesObject, *solutionsObject = Py_None;
+    Py_buffer puzzles, solutions = {0};
+    Py_ssize_t count, solutionCount = 0;
+    (void)self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", keywords, &puzzlesObject, &solutionsObject))
+        return NULL;
+    if (!pythonBoards(puzzlesObject, &puzzles, false, &count))
+        return NULL;
+    if (solutionsObject != Py_None && !pythonBoards(solutionsObject, &solutions, true, &solutionCount))
+    {
+        PyBuffer_Release(&puzzles);
+        return NULL;
+    }
+    if (solutionsObject != Py_None && solutionCount != count)
+    {
+        PyBuffer_Release(&puzzles);
+        PyBuffer_Release(&solutions);
+        PyErr_SetString(PyExc_ValueError, "puzzles and solutions must hold the same number of boards");
+        return NULL;
+    }
+    PyObject *result = PyBytes_FromStringAndSize(NULL, count);
+    if (result == NULL)
+    {
+        PyBuffer_Release(&puzzles);
+        if (solutionsObject != Py_None)
+            PyBuffer_Release(&solutions);
+        return NULL;
+    }
+
+    const unsigned char *in = puzzles.buf;
+    unsigned char *solved = solutions.buf, *counts = (unsigned char *)PyBytes_AS_STRING(result);
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t k = 0; k < count; k++)
+    {
+        int grid[N][N], solution[N][N];
+        pythonGrid(in + k * N * N, grid);
+        counts[k] = (unsigned char)bitboardSolve(grid, solution, 2);
+        for (int c = 0; solved != NULL && c < N * N; c++)
+            solved[k * N * N + c] = counts[k] > 0 ? (unsigned char)solution[c / N][c % N] : 0;
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&puzzles);
+    if (solutionsObject != Py_None)
+        PyBuffer_Release(&solutions);
+    return result;
+}
+
+// grade(puzzles) -> bytes with the band of every board, see BAND_* of the module
+static PyObject *pythonGrade(PyObject *self, PyObject *args)
+{
+    PyObject *puzzlesObject;
+    Py_buffer puzzles;
+    Py_ssize_t count;
+    (void)self;
+
+    if (!PyArg_ParseTuple(args, "O", &puzzlesObject) || !pythonBoards(puzzlesObject, &puzzles, false, &count))
+        return NULL;
+    PyObject *result = PyBytes_FromStringAndSize(NULL, count);
+    if (result == NULL)
+    {
+        PyBuffer_Release(&puzzles);
+        return NULL;
+    }
+
+    const unsigned char *in = puzzles.buf;
+    unsigned char *bands = (unsigned char *)PyBytes_AS_STRING(result);
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t k = 0; k < count; k++)
+    {
+        int grid[N][N];
+        struct grade_report report;
+        pythonGrid(in + k * N * N, grid);
+        bands[k] = (unsigned char)gradePuzzle(grid, &report);
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&puzzles);
+    return result;
+}
+
+// validate(grids, clues=None) -> bytes with 1 for every grid that is a valid completion
+static PyObject *pythonValidate(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = {"grids", "clues", NULL};
+    PyObject *gridsObject, *cluesObject = Py_None;
+    Py_buffer grids, clues = {0};
+    Py_ssize_t count, clueCount = 0;
+    (void)self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", keywords, &gridsObject, &cluesObject))
+        return NULL;
+    if (!pythonBoards(gridsObject, &grids, false, &count))
+        return NULL;
+    if (cluesObject != Py_None && !pythonBoards(cluesObject, &clues, false, &clueCount))
+    {
+        PyBuffer_Release(&grids);
+        return NULL;
+    }
+    PyObject *result = cluesObject != Py_None && clueCount != count ? NULL : PyBytes_FromStringAndSize(NULL, count);
+    if (result == NULL)
+    {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_ValueError, "grids and clues must hold the same number of boards");
+        PyBuffer_Release(&grids);
+        if (cluesObject != Py_None)
+            PyBuffer_Release(&clues);
+        return NULL;
+    }
+
+    const unsigned char *in = grids.buf, *given = clues.buf;
+    unsigned char *valid = (unsigned char *)PyBytes_AS_STRING(result);
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t k = 0; k < count; k++)
+    {
+        int grid[N][N], clueGrid[N][N];
+        for (int c = 0; c < N * N; c++)
+            grid[c / N][c % N] = in[k * N * N + c]; // a digit out of range fails the check
+        if (given != NULL)
+            pythonGrid(given + k * N * N, clueGrid);
+        valid[k] = validateGrid(grid, given != NULL ? clueGrid : NULL);
+    }
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&grids);
+    if (cluesObject != Py_None)
+        PyBuffer_Release(&clues);
+    return result;
+}
+
+static PyMethodDef pythonMethods[] = {
+    {"generate", (PyCFunction)(void (*)(void))pythonGenerate, METH_VARARGS | METH_KEYWORDS,
+     "generate(puzzles, solutions=None, level=41, seed=0)\n\n"
+     "Fill writable uint8 buffers of 81 cells per board with new puzzles and their solutions,\n"
+     "board k uses seed + k. Returns the number of boards."},
+    {"solve", (PyCFunction)(void (*)(void))pythonSolve, METH_VARARGS | METH_KEYWORDS,
+     "solve(puzzles, solutions=None)\n\n"
+     "Solve every board with the bitboard engine. Returns bytes with the number of solutions\n"
+     "of every board counted up to 2, the first solution goes to the solutions buffer."},
+    {"grade", pythonGrade, METH_VARARGS,
+     "grade(puzzles)\n\nReturns bytes with the difficulty band of every board (BAND_INVALID to BAND_HARD)."},
+    {"validate", (PyCFunction)(void (*)(void))pythonValidate, METH_VARARGS | METH_KEYWORDS,
+     "validate(grids, clues=None)\n\n"
+     "Returns bytes with 1 for every grid that follows the rules and keeps its clues, else 0."},
+    {NULL, NULL, 0, NULL}};
+
+static struct PyModuleDef pythonModule = {
+    PyModuleDef_HEAD_INIT, "sudoku", "Batch generate, solve, grade and validate Sudoku boards", -1, pythonMethods,
+    NULL, NULL, NULL, NULL};
+
+PyMODINIT_FUNC PyInit_sudoku(void)
+{
+    initTables(); // fill the unit and peer tables, read only afterwards
+    PyObject *module = PyModule_Create(&pythonModule);
+    if (module == NULL)
+        return NULL;
+    PyModule_AddIntConstant(module, "EASY", EASY_LVL);
+    PyModule_AddIntConstant(module, "MEDIUM", MEDIUM_LVL);
+    PyModule_AddIntConstant(module, "HARD", HARD_LVL);
+    PyModule_AddIntConstant(module, "BAND_INVALID", BAND_INVALID);
+    PyModule_AddIntConstant(module, "BAND_EASY", BAND_EASY);
+    PyModule_AddIntConstant(module, "BAND_MEDIUM", BAND_MEDIUM);
+    PyModule_AddIntConstant(module, "BAND_HARD", BAND_HARD);
+    return module;
+}